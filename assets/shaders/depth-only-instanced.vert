@@ -0,0 +1,15 @@
+#version 330 core
+
+// The instanced version of depth-only.vert, it must compute the position exactly like the other instanced shaders
+
+layout(location = 0) in vec3 position;
+// The object transform is read per instance (a mat4 occupies the locations 4 to 7)
+layout(location = 4) in mat4 object_to_world;
+
+uniform mat4 view_projection;
+
+invariant gl_Position;
+
+void main(){
+    gl_Position = view_projection * (object_to_world * vec4(position, 1.0));
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+// This shader is used by the depth pre-pass to write the depth of the opaque objects without shading them
+// The color pass then uses GL_EQUAL depth testing, so this shader must compute exactly the same position as the color shaders
+// That is why all of them compute "transform * vec4(position, 1.0)" and declare gl_Position as invariant
+
+layout(location = 0) in vec3 position;
+
+uniform mat4 transform;
+
+invariant gl_Position;
+
+void main(){
+    gl_Position = transform * vec4(position, 1.0);
+}
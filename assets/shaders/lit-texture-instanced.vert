@@ -0,0 +1,33 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 tex_coord;
+layout(location = 3) in vec3 normal;
+// The object transform & normal matrix are read per instance (a mat4 occupies 4 locations and a mat3 occupies 3 locations)
+layout(location = 4) in mat4 object_to_world;
+layout(location = 8) in mat3 object_to_world_inv_transpose;
+
+uniform mat4 view_projection;
+uniform vec3 camera_position;
+
+// The depth pre-pass must compute exactly the same position (see depth-only-instanced.vert)
+invariant gl_Position;
+
+out Varyings {
+    vec4 color;
+    vec2 tex_coord;
+    vec3 world;
+    vec3 view;
+    vec3 normal;
+} vs_out;
+
+void main(){
+    vec4 world = object_to_world * vec4(position, 1.0);
+    vs_out.world = world.xyz;
+    vs_out.view = camera_position - vs_out.world;
+    vs_out.normal = normalize(object_to_world_inv_transpose * normal);
+    gl_Position = view_projection * world;
+    vs_out.color = color;
+    vs_out.tex_coord = tex_coord;
+}
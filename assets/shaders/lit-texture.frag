@@ -1,14 +1,16 @@
- #version 330
+#version 330
 
-#define MAX_LIGHTS 16
+#define MAX_LIGHTS 128
+#define MAX_OBJECT_LIGHTS 8
 
 #define DIRECTIONAL 0
 #define POINT 1
 #define SPOT 2
 
+// The layout of this struct must match "LightData" in the engine (light-buffer.hpp)
 struct Light {
-    int type;
     vec3 position;
+    int type;
     vec3 direction;
     vec3 diffuse;
     vec3 specular;
@@ -16,10 +18,44 @@ struct Light {
     vec2 cone_angles; 
 };
 
-uniform Light lights[MAX_LIGHTS];
-uniform int light_count;
-
+// The lights are uploaded once per frame to a uniform buffer shared by all the lit shaders
+// If "clustered" is true, this array only holds the lights that reach everything (e.g. directional lights)
+// and the other lights are read from the cluster of the fragment (see "LightClusters" in the engine)
+layout(std140) uniform Lights {
+    int light_count;
+    bool clustered;
+    ivec4 cluster_counts;   // xyz: the number of clusters along x, y & z
+    vec4 cluster_scale;     // xy: the number of clusters per pixel, zw: the scale & bias that map log(view depth) to a z slice
+    vec4 camera_forward;
+    Light lights[MAX_LIGHTS];
+};
 
+// If enabled, only the lights listed in "object_lights" (indices into the "lights" array) are evaluated
+// The renderer picks them for each draw as the strongest lights that can reach the object
+uniform bool object_lights_enabled;
+uniform int object_light_count;
+uniform int object_lights[MAX_OBJECT_LIGHTS];
+
+// For every cluster: the offset of its first light index (x) and its light count (y)
+uniform usamplerBuffer cluster_table;
+// The light indices of all the clusters
+uniform usamplerBuffer cluster_indices;
+// The lights of the clusters, each light takes 6 texels laid out like "Light" in the uniform block
+uniform samplerBuffer cluster_lights;
+
+Light fetch_cluster_light(int index){
+    int base = index * 6;
+    vec4 position_type = texelFetch(cluster_lights, base);
+    Light light;
+    light.position = position_type.xyz;
+    light.type = floatBitsToInt(position_type.w);
+    light.direction = texelFetch(cluster_lights, base + 1).xyz;
+    light.diffuse = texelFetch(cluster_lights, base + 2).xyz;
+    light.specular = texelFetch(cluster_lights, base + 3).xyz;
+    light.attenuation = texelFetch(cluster_lights, base + 4).xyz;
+    light.cone_angles = texelFetch(cluster_lights, base + 5).xy;
+    return light;
+}
 
 struct Material {
     sampler2D albedo_tex;
@@ -53,53 +89,86 @@ vec3 compute_sky_light(vec3 normal, SkyLight sky_light) {
 }
 out vec4 frag_color;
 
-void main(){
-    vec3 view = normalize(fs_in.view);
-    vec3 normal = normalize(fs_in.normal);
-    int count = min(MAX_LIGHTS, light_count);
+// The material values of the fragment that are needed to compute the contribution of each light
+struct Surface {
+    vec3 normal;
+    vec3 view;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 ambient;
+    float shininess;
+};
 
-    vec3 accumulated_light = vec3(0.0, 0.0, 0.0);
+vec3 compute_light(Light light, Surface surface){
+    vec3 light_direction;
 
-    vec3 material_diffuse = texture(material.albedo_tex, fs_in.tex_coord).rgb;
-    vec3 material_specular = texture(material.specular_tex, fs_in.tex_coord).rgb;
-    vec3 material_ambient = material_diffuse * texture(material.ao_tex, fs_in.tex_coord).r;
-    float material_roughness = texture(material.roughness_tex, fs_in.tex_coord).r;
-    float material_shininess = 2.0 / pow(clamp(material_roughness, 0.001, 0.999), 4.0) - 2.0;
-    vec3 material_emissive = texture(material.emission_tex, fs_in.tex_coord).rgb;
+    float attenuation = 1;
 
+    if(light.type == DIRECTIONAL)
+        light_direction = light.direction;
 
-    for(int i = 0; i < count; i++){
+    else {
 
-        Light light = lights[i];
-        vec3 light_direction;
+        light_direction = fs_in.world - light.position;
+        float distance = length(light_direction);
+        light_direction /= distance;
+        attenuation *= 1.0f / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * distance * distance);
 
-        float attenuation = 1;
+        if(light.type == SPOT){
+            float angle = acos(dot(light.direction, light_direction));
+            attenuation *= smoothstep(light.cone_angles.y, light.cone_angles.x, angle);
+        }
 
-        if(light.type == DIRECTIONAL)
-            light_direction = light.direction;
+    }
 
-        else {
+    vec3 reflected = reflect(light_direction, surface.normal);
+    float lambert = max(0.0f, dot(surface.normal, -light_direction));
+    float phong = pow(max(0.0f, dot(surface.view, reflected)), surface.shininess);
+    vec3 diffuse = surface.diffuse * light.diffuse * lambert;
+    vec3 specular = surface.specular * light.specular * phong;
+    vec3 ambient = surface.ambient * light.diffuse;
+    return (diffuse + specular) * attenuation + ambient;
+}
 
-            light_direction = fs_in.world - light.position;
-            float distance = length(light_direction);
-            light_direction /= distance;
-            attenuation *= 1.0f / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * distance * distance);
+void main(){
+    Surface surface;
+    surface.view = normalize(fs_in.view);
+    surface.normal = normalize(fs_in.normal);
+    int count = min(MAX_LIGHTS, light_count);
 
-            if(light.type == SPOT){
-                float angle = acos(dot(light.direction, light_direction));
-                attenuation *= smoothstep(light.cone_angles.y, light.cone_angles.x, angle);
-            }
+    vec3 accumulated_light = vec3(0.0, 0.0, 0.0);
 
-        }
+    surface.diffuse = texture(material.albedo_tex, fs_in.tex_coord).rgb;
+    surface.specular = texture(material.specular_tex, fs_in.tex_coord).rgb;
+    surface.ambient = surface.diffuse * texture(material.ao_tex, fs_in.tex_coord).r;
+    float material_roughness = texture(material.roughness_tex, fs_in.tex_coord).r;
+    surface.shininess = 2.0 / pow(clamp(material_roughness, 0.001, 0.999), 4.0) - 2.0;
+    vec3 material_emissive = texture(material.emission_tex, fs_in.tex_coord).rgb;
 
-        vec3 reflected = reflect(light_direction, normal);
-        float lambert = max(0.0f, dot(normal, -light_direction));
-        float phong = pow(max(0.0f, dot(view, reflected)), material_shininess);
-        vec3 diffuse = material_diffuse * light.diffuse * lambert;
-        vec3 specular = material_specular * light.specular * phong;
-        vec3 ambient = material_ambient * light.diffuse;
-        accumulated_light += (diffuse + specular) * attenuation + ambient;
 
+    if(object_lights_enabled){
+        int object_count = min(MAX_OBJECT_LIGHTS, object_light_count);
+        for(int i = 0; i < object_count; i++){
+            accumulated_light += compute_light(lights[object_lights[i]], surface);
+        }
+    } else {
+        for(int i = 0; i < count; i++){
+            accumulated_light += compute_light(lights[i], surface);
+        }
+    }
+
+    if(clustered){
+        // Find the cluster from the pixel position and the view depth (the depth slices are exponential so we use the log of the depth)
+        // fs_in.view points from the fragment to the camera, so the view depth is its negated projection on the camera forward
+        float depth = max(-dot(fs_in.view, camera_forward.xyz), 1e-4);
+        ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * cluster_scale.xy), int(log(depth) * cluster_scale.z + cluster_scale.w));
+        cluster = clamp(cluster, ivec3(0), cluster_counts.xyz - 1);
+        int cluster_index = cluster.x + cluster_counts.x * (cluster.y + cluster_counts.y * cluster.z);
+        uvec2 range = texelFetch(cluster_table, cluster_index).xy;
+        for(uint i = 0u; i < range.y; i++){
+            int light_index = int(texelFetch(cluster_indices, int(range.x + i)).r);
+            accumulated_light += compute_light(fetch_cluster_light(light_index), surface);
+        }
     }
     
     frag_color = fs_in.color * vec4(accumulated_light, 1.0f);
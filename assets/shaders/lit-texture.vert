@@ -6,9 +6,14 @@ layout(location = 2) in vec2 tex_coord;
 layout(location = 3) in vec3 normal;
 
 uniform mat4 object_to_world;
-uniform mat4 object_to_wolrd_inv_transpose;
-uniform mat4 view_projection;
+// The inverse transpose of the upper 3x3 part of object_to_world (used to transform the normals)
+uniform mat3 object_to_world_inv_transpose;
 uniform vec3 camera_position;
+// The model-view-projection matrix, it is used to compute the position
+// since the depth pre-pass must compute exactly the same position (see depth-only.vert)
+uniform mat4 transform;
+
+invariant gl_Position;
 
 out Varyings {
     vec4 color;
@@ -21,8 +26,8 @@ out Varyings {
 void main(){
     vs_out.world = (object_to_world * vec4(position, 1.0)).xyz;
     vs_out.view = camera_position - vs_out.world;
-    vs_out.normal = normalize((object_to_wolrd_inv_transpose * vec4(normal, 0.0)).xyz);
-    gl_Position = view_projection * vec4(vs_out.world, 1.0);
+    vs_out.normal = normalize(object_to_world_inv_transpose * normal);
+    gl_Position = transform * vec4(position, 1.0);
     vs_out.color = color;
     vs_out.tex_coord = tex_coord;
 }
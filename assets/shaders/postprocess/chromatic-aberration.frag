@@ -9,7 +9,9 @@ out vec4 frag_color;
 
 // How far (in the texture space) is the distance (on the x-axis) between
 // the pixels from which the red/green (or green/blue) channels are sampled
-#define STRENGTH 0.005
+// It can be changed from the "uniforms" of the postprocess pass in the renderer configuration
+uniform float strength = 0.005;
+#define STRENGTH strength
 
 // Chromatic aberration mimics some old cameras where the lens disperses light
 // differently based on its wavelength. In this shader, we will implement a
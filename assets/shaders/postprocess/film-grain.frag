@@ -7,10 +7,13 @@ uniform sampler2D tex;
 in vec2 tex_coord;
 out vec4 frag_color;
 
+// The noise amount, it can be changed from the "uniforms" of the postprocess pass in the renderer configuration
+uniform float amount = 0.1;
+
 void main(){
 
     // Calculate noise
-    float mdf = 0.1; // noise amount 
+    float mdf = amount; // noise amount 
     float noise = (fract(sin(dot(tex_coord, vec2(12.9898,78.233)*2.0)) * 43758.5453));
 
     frag_color = texture(tex, tex_coord);
@@ -0,0 +1,23 @@
+#version 330 core
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 2) in vec2 tex_coord;
+// The object transform is read per instance (a mat4 occupies the locations 4 to 7)
+layout(location = 4) in mat4 object_to_world;
+
+out Varyings {
+    vec4 color;
+    vec2 tex_coord;
+} vs_out;
+
+uniform mat4 view_projection;
+
+// The depth pre-pass must compute exactly the same position (see depth-only-instanced.vert)
+invariant gl_Position;
+
+void main(){
+    gl_Position = view_projection * (object_to_world * vec4(position, 1.0));
+    vs_out.color = color;
+    vs_out.tex_coord = tex_coord;
+}
@@ -11,9 +11,12 @@ out Varyings {
 
 uniform mat4 transform;
 
+// The depth pre-pass must compute exactly the same position (see depth-only.vert)
+invariant gl_Position;
+
 void main(){
     //TODO: (Req 7) Change the next line to apply the transformation matrix
-    gl_Position = transform *vec4(position, 1.0);
+    gl_Position = transform * vec4(position, 1.0);
     vs_out.color = color;
     vs_out.tex_coord = tex_coord;
 }
\ No newline at end of file
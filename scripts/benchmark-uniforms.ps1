@@ -0,0 +1,18 @@
+param([int] $frames = 1000)
+
+# Runs some scenes with and without the uniform location cache and prints the average CPU time of onDraw for each run
+# Usage: ./scripts/benchmark-uniforms.ps1 -frames 1000
+
+$configs = @(
+    "config/material-test/test-1.jsonc",
+    "config/renderer-test/test-0.jsonc",
+    "config/renderer-test/test-1.jsonc"
+)
+
+foreach ($config in $configs){
+    foreach ($cache in @("true", "false")){
+        Write-Output ""
+        Write-Output "Running $config with uniform-cache=$cache"
+        ./bin/GAME_APPLICATION -f="$frames" -c="$config" -uniform-cache="$cache" | Select-String -Pattern "Average CPU time", "Uniform location queries"
+    }
+}
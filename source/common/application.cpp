@@ -9,6 +9,7 @@
 #include <queue>
 #include <tuple>
 #include <filesystem>
+#include <chrono>
 
 #include <flags/flags.h>
 
@@ -23,6 +24,9 @@
 #endif
 
 #include "texture/screenshot.hpp"
+#include "gl-state-cache.hpp"
+#include "shader/shader.hpp"
+#include "gpu-profiler.hpp"
 
 std::string default_screenshot_filepath() {
     std::stringstream stream;
@@ -238,18 +242,32 @@ int our::Application::run(int run_for_frames) {
     // The time at which the last frame started. But there was no frames yet, so we'll just pick the current time.
     double last_frame_time = glfwGetTime();
     int current_frame = 0;
+    // The total CPU time spent in onDraw and the number of uniform location queries sent to the driver
+    // They are printed when the application is run for a fixed number of frames (useful for benchmarking)
+    double total_draw_time = 0;
+    uint64_t start_location_queries = our::ShaderProgram::locationQueries;
+    // The GPU time of the whole frame (the state drawing & ImGui) and of ImGui alone
+    our::GpuScopeId frame_scope = our::GpuProfiler::registerScope("frame");
+    our::GpuScopeId imgui_scope = our::GpuProfiler::registerScope("imgui");
 
     //Game loop
     while(!glfwWindowShouldClose(window)){
         if(run_for_frames != 0 && current_frame >= run_for_frames) break;
         glfwPollEvents(); // Read all the user events and call relevant callbacks.
 
+        // Start counting the state changes of the new frame. This also invalidates the state cache
+        // since ImGui changed the OpenGL state (while drawing the last frame) without going through the cache
+        our::GLStateCache::newFrame();
+        // Collect the GPU timings of an older frame (if the profiler is enabled)
+        our::GpuProfiler::beginFrame();
+
         // Start a new ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
         if(currentState) currentState->onImmediateGui(); // Call to run any required Immediate GUI.
+        our::GpuProfiler::onImmediateGui();
 
         // If ImGui is using the mouse or keyboard, then we don't want the captured events to affect our keyboard and mouse objects.
         // For example, if you're focusing on an input and writing "W", the keyboard object shouldn't record this event.
@@ -268,7 +286,10 @@ int our::Application::run(int run_for_frames) {
         double current_frame_time = glfwGetTime();
 
         // Call onDraw, in which we will draw the current frame, and send to it the time difference between the last and current frame
+        our::GpuProfiler::begin(frame_scope);
+        auto draw_start = std::chrono::high_resolution_clock::now();
         if(currentState) currentState->onDraw(current_frame_time - last_frame_time);
+        total_draw_time += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - draw_start).count();
         last_frame_time = current_frame_time; // Then update the last frame start time (this frame is now the last frame)
 
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
@@ -276,7 +297,10 @@ int our::Application::run(int run_for_frames) {
         glDisable(GL_DEBUG_OUTPUT);
         glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 #endif
+        our::GpuProfiler::begin(imgui_scope);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData()); // Render the ImGui to the framebuffer
+        our::GpuProfiler::end(imgui_scope);
+        our::GpuProfiler::end(frame_scope);
 #if defined(ENABLE_OPENGL_DEBUG_MESSAGES)
         // Re-enable the debug messages
         glEnable(GL_DEBUG_OUTPUT);
@@ -326,8 +350,21 @@ int our::Application::run(int run_for_frames) {
         ++current_frame;
     }
 
+    if(run_for_frames != 0 && current_frame > 0){
+        std::cout << "Average CPU time of onDraw: " << total_draw_time / current_frame << " ms over " << current_frame << " frames" << std::endl;
+        std::cout << "Uniform location queries per frame: " << double(our::ShaderProgram::locationQueries - start_location_queries) / current_frame << std::endl;
+    }
+
+    // If a GPU profile was requested, write it before the queries are deleted
+    if(!our::GpuProfiler::reportPath.empty()){
+        if(our::GpuProfiler::writeJson(our::GpuProfiler::reportPath)){
+            std::cout << "GPU profile saved to: " << our::GpuProfiler::reportPath << std::endl;
+        }
+    }
+
     // Call for cleaning up
     if(currentState) currentState->onDestroy();
+    our::GpuProfiler::destroy();
 
     // Shutdown ImGui & destroy the context
     ImGui_ImplOpenGL3_Shutdown();
@@ -63,12 +63,21 @@ namespace our {
     // This will load all the meshes defined in "data"
     // data must be in the form:
     //    { mesh_name : "path/to/3d-model-file", ... }
+    // A mesh can also be given as { "path": "path/to/3d-model-file", "lods": [0.5, 0.25, ...] }
+    // which also generates a simplified mesh for every ratio in "lods" named "mesh_name-lod1", "mesh_name-lod2", etc.
     template<>
     void AssetLoader<Mesh>::deserialize(const nlohmann::json& data) {
         if(data.is_object()){
             for(auto& [name, desc] : data.items()){
-                std::string path = desc.get<std::string>();
-                assets[name] = mesh_utils::loadOBJ(path);
+                if(desc.is_object()){
+                    std::vector<Mesh*> meshes = mesh_utils::loadOBJLods(desc.value("path", ""), desc.value("lods", std::vector<float>()));
+                    for(size_t level = 0; level < meshes.size(); level++){
+                        assets[level == 0 ? name : name + "-lod" + std::to_string(level)] = meshes[level];
+                    }
+                } else {
+                    std::string path = desc.get<std::string>();
+                    assets[name] = mesh_utils::loadOBJ(path);
+                }
             }
         }
     };
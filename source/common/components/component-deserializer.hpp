@@ -6,32 +6,44 @@
 #include "free-camera-controller.hpp"
 #include "movement.hpp"
 #include "light.hpp"
-#include <iostream>
 #include "collision.hpp"
+#include <array>
+#include <string>
 
 namespace our {
 
+    // A function that creates a component of a certain type in the given entity
+    struct ComponentFactory {
+        std::string name; // The ID (getID) of the component type
+        Component* (*create)(Entity* entity);
+    };
+
+    // Generates the factory table from the list of component types, the factory of each type is at the index of its type id
+    template<typename... Ts>
+    std::array<ComponentFactory, sizeof...(Ts)> makeComponentFactories(TypeList<Ts...>){
+        return {{ {Ts::getID(), [](Entity* entity) -> Component* { return entity->addComponent<Ts>(); }}... }};
+    }
+
+    // Returns the factories of all the component types (indexed by the component type id)
+    inline const std::array<ComponentFactory, COMPONENT_TYPE_COUNT>& getComponentFactories(){
+        static const std::array<ComponentFactory, COMPONENT_TYPE_COUNT> factories = makeComponentFactories(ComponentTypes{});
+        return factories;
+    }
+
     // Given a json object, this function picks and creates a component in the given entity
     // based on the "type" specified in the json object which is later deserialized from the rest of the json object
     inline void deserializeComponent(const nlohmann::json& data, Entity* entity){
         std::string type = data.value("type", "");
         Component* component = nullptr;
-        //TODO: (Req 8) Add an option to deserialize a "MeshRendererComponent" to the following if-else statement.
-        if(type == CameraComponent::getID()){
-            component = entity->addComponent<CameraComponent>();
-        } else if (type == FreeCameraControllerComponent::getID()) {
-            component = entity->addComponent<FreeCameraControllerComponent>();
-        } else if (type == MovementComponent::getID()) {
-            component = entity->addComponent<MovementComponent>();
-        } else if (type == MeshRendererComponent::getID()) {
-            component = entity->addComponent<MeshRendererComponent>();
-        }else if (type == LightComponent::getID()) {
-            component = entity->addComponent<LightComponent>();
-        } else if (type == CollisionComponent::getID()) {
-            component = entity->addComponent<CollisionComponent>();
+        // There are only a few component types, so the table is searched linearly
+        for(const auto& factory : getComponentFactories()){
+            if(type == factory.name){
+                component = factory.create(entity);
+                break;
+            }
         }
 
         if(component) component->deserialize(data);
     }
 
-}
\ No newline at end of file
+}
@@ -14,5 +14,23 @@ namespace our {
 
         mesh = AssetLoader<Mesh>::get(data["mesh"].get<std::string>());
         material = AssetLoader<Material>::get(data["material"].get<std::string>());
+        // Giving an occluder mesh marks the object as an occluder
+        occluderMesh = data.contains("occluderMesh") ? AssetLoader<Mesh>::get(data["occluderMesh"].get<std::string>()) : nullptr;
+        occluder = data.value("occluder", occluderMesh != nullptr);
+        // Only the occluder meshes keep a copy of their positions & elements on the RAM for the CPU rasterization
+        Mesh* rasterizedMesh = occluderMesh ? occluderMesh : mesh;
+        if(occluder && rasterizedMesh) rasterizedMesh->keepOccluderData();
+        // The levels of detail are given as [{ "mesh": "car-lod1", "screenSize": 0.2 }, ...] (see the "lods" of the mesh assets)
+        lods.clear();
+        if(data.contains("lods")){
+            for(auto& lod : data["lods"]){
+                lods.push_back({AssetLoader<Mesh>::get(lod["mesh"].get<std::string>()), lod.value("screenSize", 0.0f)});
+            }
+        }
+        lodHysteresis = data.value("lodHysteresis", 0.1f);
+        isStatic = data.value("static", false);
+        currentLod = 0;
+        occlusionQuery = OcclusionQueryMode::AUTO;
+        if(data.contains("occlusionQuery")) occlusionQuery = data["occlusionQuery"].get<bool>() ? OcclusionQueryMode::ALWAYS : OcclusionQueryMode::NEVER;
     }
 }
\ No newline at end of file
@@ -5,13 +5,60 @@
 #include "../material/material.hpp"
 #include "../asset-loader.hpp"
 
+#include <memory>
+#include <vector>
+
 namespace our {
 
+    // Whether the renderer draws an object under a hardware occlusion query (see "ForwardRenderer")
+    // AUTO leaves the decision to the renderer (it queries the meshes with many triangles)
+    enum class OcclusionQueryMode {
+        AUTO,
+        ALWAYS,
+        NEVER
+    };
+
+    // A simplified mesh used instead of the full mesh when the object looks smaller than "screenSize" on the screen
+    // The screen size is the diameter of the bounding sphere of the object relative to the screen height
+    struct MeshLod {
+        Mesh* mesh;
+        float screenSize;
+    };
+
     // This component denotes that any renderer should draw the given mesh using the given material at the transformation of the owning entity.
     class MeshRendererComponent : public Component {
     public:
         Mesh* mesh; // The mesh that should be drawn
         Material* material; // The material used to draw the mesh
+        // If true, the object hides the objects behind it in the CPU occlusion culling (see "OcclusionCuller")
+        // The rasterized mesh is "occluderMesh" if it is given, otherwise it is the drawn mesh. The occluder mesh should be a low-poly mesh
+        // that fits inside the drawn mesh, so that it never hides something that the drawn mesh doesn't hide
+        bool occluder = false;
+        Mesh* occluderMesh = nullptr;
+        // If true, the object never moves, so it is merged with the other static objects sharing its material when the world is loaded
+        // (see "World::buildStaticBatches"). The objects with levels of detail or used as occluders are not merged since they need their own mesh
+        bool isStatic = false;
+        // A mesh created for this component only (e.g. the merged mesh of a static batch). It is deleted with the component
+        std::unique_ptr<Mesh> ownedMesh;
+        // The levels of detail after the full mesh ordered from the most to the least detailed (so their screen sizes are decreasing)
+        std::vector<MeshLod> lods;
+        // To avoid switching back and forth when the size is close to a threshold, a coarser level is picked when the size goes below the threshold
+        // by this fraction, and a finer level is picked when it goes above the threshold by this fraction
+        float lodHysteresis = 0.1f;
+        // The level picked by the renderer in the last frame (0 is the full mesh). Only the renderer thread extracting this entity writes it
+        int currentLod = 0;
+        // Set by "occlusionQuery" in the json (true or false), if it is not given the renderer decides by the triangle count of the mesh
+        OcclusionQueryMode occlusionQuery = OcclusionQueryMode::AUTO;
+
+        // Returns the level of detail for the given screen size taking the hysteresis into account, and remembers it for the next frame
+        int selectLod(float screenSize){
+            int lod = glm::clamp(currentLod, 0, (int)lods.size());
+            while(lod < (int)lods.size() && screenSize < lods[lod].screenSize * (1.0f - lodHysteresis)) lod++;
+            while(lod > 0 && screenSize > lods[lod - 1].screenSize * (1.0f + lodHysteresis)) lod--;
+            return currentLod = lod;
+        }
+        // Returns the mesh of the given level of detail
+        Mesh* getLodMesh(int lod) const { return lod == 0 ? mesh : lods[lod - 1].mesh; }
 
         // The ID of this component type is "Mesh Renderer"
         static std::string getID() { return "Mesh Renderer"; }
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "component.hpp"
+#include "component-types.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace our {
+
+    class Entity; // A forward declaration of the Entity Class
+
+    // Everything that the archetypes need to know to store the components of a type without knowing the type at compile time
+    struct ComponentTypeInfo {
+        ComponentTypeId id;
+        size_t size, alignment;
+        void (*construct)(void* memory);                     // Creates a default component in the given memory
+        void (*moveConstruct)(void* destination, void* source); // Creates a component in "destination" by moving the one in "source"
+        void (*destroy)(void* component);                    // Calls the destructor of the component
+        Component* (*toComponent)(void* component);          // Converts a pointer to the component memory to a pointer to its base class
+    };
+
+    namespace component_types {
+        // Returns the type information of the component type T (the same object is returned every time)
+        template<typename T>
+        const ComponentTypeInfo& get(){
+            static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+            // The chunks are allocated using "new", so they are only aligned to the default alignment
+            static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "The component is over aligned");
+            static const ComponentTypeInfo info = {
+                componentTypeId<T>, sizeof(T), alignof(T),
+                [](void* memory){ new (memory) T(); },
+                [](void* destination, void* source){ new (destination) T(std::move(*static_cast<T*>(source))); },
+                [](void* component){ static_cast<T*>(component)->~T(); },
+                [](void* component) -> Component* { return static_cast<T*>(component); }
+            };
+            return info;
+        }
+    }
+
+    // An archetype stores all the entities that have exactly the same set of component types
+    // Instead of allocating every component on its own, the components are stored in chunks (structure of arrays):
+    // each chunk has a contiguous array for every component type and row "i" of all the arrays belongs to the same entity.
+    // So a system that only needs one component type walks over a contiguous array instead of chasing a pointer per entity.
+    // The rows are always packed: when a row is removed, the last row is moved into its place.
+    // Since the chunks are never reallocated, a component only moves when its entity changes its archetype or a row before it is removed.
+    class Archetype {
+    public:
+        // The size of the chunks in bytes (the number of rows per chunk depends on the size of the components)
+        static constexpr size_t CHUNK_BYTES = 16 * 1024;
+
+    private:
+        std::vector<const ComponentTypeInfo*> types; // The component types of the archetype sorted by their id
+        ComponentMask mask = 0; // The set of the component types of the archetype
+        int8_t slots[COMPONENT_TYPE_COUNT]; // The column of each component type id (or -1 if the archetype doesn't have it)
+        std::vector<size_t> columnOffsets; // The offset of the array of each component type in a chunk
+        size_t chunkCapacity = 1; // The number of rows per chunk
+        size_t chunkBytes = 0;
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        std::vector<Entity*> entities; // The entity that owns each row
+
+        // The archetypes that an entity of this archetype moves to when a component type (indexed by its id) is added or removed
+        // They are cached by the world so that it doesn't have to look up the archetype of the new mask every time
+        Archetype* addTransitions[COMPONENT_TYPE_COUNT] = {};
+        Archetype* removeTransitions[COMPONENT_TYPE_COUNT] = {};
+        friend class World;
+
+    public:
+        explicit Archetype(std::vector<const ComponentTypeInfo*> types) : types(std::move(types)) {
+            size_t rowBytes = 0;
+            std::fill(std::begin(slots), std::end(slots), -1);
+            for(size_t column = 0; column < this->types.size(); column++){
+                mask |= ComponentMask(1) << this->types[column]->id;
+                slots[this->types[column]->id] = (int8_t)column;
+                rowBytes += this->types[column]->size;
+            }
+            chunkCapacity = rowBytes == 0 ? CHUNK_BYTES : std::max<size_t>(1, CHUNK_BYTES / rowBytes);
+            for(auto type : this->types){
+                chunkBytes = (chunkBytes + type->alignment - 1) / type->alignment * type->alignment;
+                columnOffsets.push_back(chunkBytes);
+                chunkBytes += type->size * chunkCapacity;
+            }
+        }
+
+        // The entities must remove their rows before the archetype is deleted, but in case some are left, their components are destroyed
+        ~Archetype(){
+            for(size_t row = 0; row < entities.size(); row++){
+                for(size_t column = 0; column < types.size(); column++) types[column]->destroy(getComponent(column, row));
+            }
+        }
+
+        Archetype(const Archetype&) = delete;
+        Archetype& operator=(const Archetype&) = delete;
+
+        const std::vector<const ComponentTypeInfo*>& getTypes() const { return types; }
+        ComponentMask getMask() const { return mask; }
+
+        // Returns the index of the column that stores the given component type or -1 if the archetype doesn't have it
+        int findColumn(ComponentTypeId id) const { return slots[id]; }
+        bool has(ComponentTypeId id) const { return (mask >> id) & 1; }
+
+        // The number of entities (rows) in this archetype
+        size_t size() const { return entities.size(); }
+        Entity* getEntity(size_t row) const { return entities[row]; }
+
+        // Returns the memory of the component in the given column & row
+        void* getComponent(size_t column, size_t row) const {
+            return chunks[row / chunkCapacity].get() + columnOffsets[column] + (row % chunkCapacity) * types[column]->size;
+        }
+
+        // The rows are split into chunks, all the chunks are full except the last one
+        size_t getChunkCount() const { return (entities.size() + chunkCapacity - 1) / chunkCapacity; }
+        size_t getChunkCapacity() const { return chunkCapacity; }
+        size_t getChunkSize(size_t chunk) const { return std::min(chunkCapacity, entities.size() - chunk * chunkCapacity); }
+
+        // Returns the array of the components of type T in the given chunk (or null if the archetype doesn't have T)
+        template<typename T>
+        T* getColumn(size_t chunk) const {
+            int column = slots[componentTypeId<T>];
+            if(column < 0) return nullptr;
+            return reinterpret_cast<T*>(chunks[chunk].get() + columnOffsets[column]);
+        }
+        // Returns the array of the entities of the rows in the given chunk
+        Entity* const* getChunkEntities(size_t chunk) const { return entities.data() + chunk * chunkCapacity; }
+
+        // Adds a row for the given entity and returns its index. The components of the row are not constructed
+        size_t allocateRow(Entity* entity){
+            if(entities.size() == chunks.size() * chunkCapacity) chunks.emplace_back(new std::byte[chunkBytes]);
+            entities.push_back(entity);
+            return entities.size() - 1;
+        }
+
+        // Removes the given row, its components must have already been destroyed (or moved out)
+        // To keep the rows packed, the last row is moved into its place and its entity is returned so that it can update its row
+        // If the removed row was the last one, null is returned
+        Entity* releaseRow(size_t row){
+            size_t last = entities.size() - 1;
+            Entity* moved = nullptr;
+            if(row != last){
+                for(size_t column = 0; column < types.size(); column++){
+                    void* source = getComponent(column, last);
+                    types[column]->moveConstruct(getComponent(column, row), source);
+                    types[column]->destroy(source);
+                }
+                moved = entities[row] = entities[last];
+            }
+            entities.pop_back();
+            return moved;
+        }
+    };
+
+}
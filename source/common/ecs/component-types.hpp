@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace our {
+
+    // Forward declarations of all the component types (the ids only need the names of the types)
+    class CameraComponent;
+    class FreeCameraControllerComponent;
+    class MovementComponent;
+    class MeshRendererComponent;
+    class LightComponent;
+    class CollisionComponent;
+
+    // A list of types that can be processed at compile time
+    template<typename... Ts>
+    struct TypeList {
+        static constexpr size_t size = sizeof...(Ts);
+    };
+
+    // All the component types. The id of a component type is its index in this list,
+    // so it is known at compile time and the components of an entity can be found using a bitmask instead of dynamic_cast
+    // When you create a new type of components, add it to the end of this list
+    using ComponentTypes = TypeList<
+        CameraComponent,
+        FreeCameraControllerComponent,
+        MovementComponent,
+        MeshRendererComponent,
+        LightComponent,
+        CollisionComponent
+    >;
+
+    // A number that identifies each component type
+    using ComponentTypeId = uint32_t;
+    // A set of component types where the bit "id" is set if the set contains the type with that id
+    using ComponentMask = uint32_t;
+
+    constexpr ComponentTypeId COMPONENT_TYPE_COUNT = ComponentTypes::size;
+    static_assert(COMPONENT_TYPE_COUNT <= 32, "ComponentMask can only hold 32 component types");
+
+    namespace component_types {
+        template<typename T>
+        constexpr bool alwaysFalse = false;
+
+        // Finds the index of the type T in a type list
+        template<typename T, typename List>
+        struct IndexOf;
+        template<typename T>
+        struct IndexOf<T, TypeList<>> {
+            static_assert(alwaysFalse<T>, "The component type is not listed in ComponentTypes (see component-types.hpp)");
+        };
+        template<typename T, typename... Ts>
+        struct IndexOf<T, TypeList<T, Ts...>> : std::integral_constant<ComponentTypeId, 0> {};
+        template<typename T, typename U, typename... Ts>
+        struct IndexOf<T, TypeList<U, Ts...>> : std::integral_constant<ComponentTypeId, 1 + IndexOf<T, TypeList<Ts...>>::value> {};
+    }
+
+    // The compile time id of the component type T and the mask that only contains T
+    template<typename T>
+    constexpr ComponentTypeId componentTypeId = component_types::IndexOf<T, ComponentTypes>::value;
+    template<typename T>
+    constexpr ComponentMask componentMask = ComponentMask(1) << componentTypeId<T>;
+
+}
@@ -1,4 +1,5 @@
 #include "entity.hpp"
+#include "world.hpp"
 #include "../deserialize-utils.hpp"
 #include "../components/component-deserializer.hpp"
 
@@ -10,8 +11,11 @@ namespace our {
     // Remember that you can get the transformation matrix from this entity to its parent from "localTransform"
     // To get the local to world matrix, you need to combine this entities matrix with its parent's matrix and
     // its parent's parent's matrix and so on till you reach the root.
+    // If nothing changed since the last update pass (see World::updateTransforms), the cached matrix is returned.
+    // Otherwise it is computed without writing to the cache, so it is safe to call this from multiple threads
     glm::mat4 Entity::getLocalToWorldMatrix() const {
         //TODO: (Req 8) Write this function to return the transformation
+        if(isTransformCached()) return worldMatrix;
         glm::mat4 localToWorld = localTransform.toMat4();
         if(parent != nullptr){
             localToWorld = parent->getLocalToWorldMatrix() * localToWorld;
@@ -19,6 +23,14 @@ namespace our {
         return localToWorld;
     }
 
+    bool Entity::isTransformCached() const {
+        // Comparing the transforms up the parent chain is much cheaper than building their matrices
+        for(const Entity* entity = this; entity != nullptr; entity = entity->parent){
+            if(entity->transformDirty || entity->parent != entity->cachedParent || entity->localTransform != entity->cachedTransform) return false;
+        }
+        return true;
+    }
+
     // Deserializes the entity data and components from a json object
     void Entity::deserialize(const nlohmann::json& data){
         if(!data.is_object()) return;
@@ -33,4 +45,57 @@ namespace our {
         }
     }
 
+    void* Entity::addComponentOfType(const ComponentTypeInfo& type){
+        if(archetype){
+            if(int column = archetype->findColumn(type.id); column >= 0){
+                // The entity already has a component of this type, so it is replaced by a new one
+                void* memory = archetype->getComponent(column, row);
+                type.destroy(memory);
+                type.construct(memory);
+                return memory;
+            }
+        }
+        moveToArchetype(world->getArchetypeWith(archetype, type));
+        return archetype->getComponent(archetype->findColumn(type.id), row);
+    }
+
+    void Entity::deleteComponentOfType(ComponentTypeId id){
+        if(!((mask >> id) & 1)) return;
+        moveToArchetype(world->getArchetypeWithout(archetype, id));
+    }
+
+    void Entity::moveToArchetype(Archetype* target){
+        Archetype* source = archetype;
+        size_t sourceRow = row;
+        if(source == target) return;
+        size_t targetRow = 0;
+        if(target){
+            targetRow = target->allocateRow(this);
+            const auto& types = target->getTypes();
+            for(size_t column = 0; column < types.size(); column++){
+                void* destination = target->getComponent(column, targetRow);
+                int sourceColumn = source ? source->findColumn(types[column]->id) : -1;
+                if(sourceColumn >= 0){
+                    void* component = source->getComponent(sourceColumn, sourceRow);
+                    types[column]->moveConstruct(destination, component);
+                    types[column]->destroy(component);
+                } else {
+                    types[column]->construct(destination);
+                    types[column]->toComponent(destination)->owner = this;
+                }
+            }
+        }
+        if(source){
+            // Destroy the components that were not moved to the target, then give the row back
+            const auto& types = source->getTypes();
+            for(size_t column = 0; column < types.size(); column++){
+                if(!target || !target->has(types[column]->id)) types[column]->destroy(source->getComponent(column, sourceRow));
+            }
+            if(Entity* moved = source->releaseRow(sourceRow); moved) moved->row = sourceRow;
+        }
+        archetype = target;
+        row = targetRow;
+        mask = target ? target->getMask() : 0;
+    }
+
 }
\ No newline at end of file
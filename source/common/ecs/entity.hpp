@@ -1,9 +1,8 @@
 #pragma once
 
 #include "component.hpp"
+#include "archetype.hpp"
 #include "transform.hpp"
-#include <list>
-#include <iterator>
 #include <string>
 #include <glm/glm.hpp>
 
@@ -13,100 +12,105 @@ namespace our {
 
     class Entity{
         World *world; // This defines what world own this entity
-        std::list<Component*> components; // A list of components that are owned by this entity
+        // The components of the entity are stored in the row "row" of the archetype that matches its set of component types
+        // If the entity has no components, "archetype" is null
+        Archetype* archetype = nullptr;
+        size_t row = 0;
+        // The set of the component types of the entity (a copy of the mask of its archetype, so checking for a type doesn't touch the archetype)
+        ComponentMask mask = 0;
 
         friend World; // The world is a friend since it is the only class that is allowed to instantiate an entity
         Entity() = default; // The entity constructor is private since only the world is allowed to instantiate an entity
+
+        // Returns the memory of the component of the given type (a new default component is created if the entity doesn't have one)
+        void* addComponentOfType(const ComponentTypeInfo& type);
+        // Deletes the component of the given type if the entity has one
+        void deleteComponentOfType(ComponentTypeId id);
+        // Moves the components of the entity to a row in the "target" archetype
+        // The component types that are only in the target are default constructed and the ones that are not in the target are destroyed
+        void moveToArchetype(Archetype* target);
+
+        // Returns the base class pointer of the component in the given column of the entity's archetype
+        Component* getComponentInColumn(size_t column) const {
+            return archetype->getTypes()[column]->toComponent(archetype->getComponent(column, row));
+        }
     public:
         std::string name; // The name of the entity. It could be useful to refer to an entity by its name
-        Entity* parent;   // The parent of the entity. The transform of the entity is relative to its parent.
+        Entity* parent = nullptr; // The parent of the entity. The transform of the entity is relative to its parent.
                           // If parent is null, the entity is a root entity (has no parent).
         Transform localTransform; // The transform of this entity relative to its parent.
-
+    private:
+        // The cached matrices are computed by "World::updateTransforms" from "cachedTransform" & "cachedParent"
+        // "localTransform" & "parent" are public so any code can change them, so the entity is dirty if they differ from the cached copies
+        // These are declared right after "parent" & "localTransform" so that comparing them touches as few cache lines as possible
+        Transform cachedTransform;
+        Entity* cachedParent = nullptr;
+        bool transformDirty = true;   // Set when the entity is created (and can be set by "markTransformDirty") to force an update
+        glm::mat4 localMatrix = glm::mat4(1.0f), worldMatrix = glm::mat4(1.0f);
+    public:
         World* getWorld() const { return world; } // Returns the world to which this entity belongs
+        Archetype* getArchetype() const { return archetype; } // Returns the archetype that stores the components of this entity
+        ComponentMask getMask() const { return mask; } // Returns the set of the component types of this entity
+
+        // Returns true if the entity has a component of type T
+        template<typename T>
+        bool hasComponent() const { return mask & componentMask<T>; }
 
         glm::mat4 getLocalToWorldMatrix() const; // Computes and returns the transformation from the entities local space to the world space
+        // Returns true if the cached world matrix is up to date (the entity and all its ancestors didn't change since the last update pass)
+        bool isTransformCached() const;
+        // Forces the next update pass to recompute the matrices of this entity and its descendants
+        void markTransformDirty() { transformDirty = true; }
         void deserialize(const nlohmann::json&); // Deserializes the entity data and components from a json object
         
-        // This template method create a component of type T,
-        // adds it to the components map and returns a pointer to it 
+        // This template method create a component of type T, adds it to the entity and returns a pointer to it
+        // An entity can only have one component of each type, so if it already has a T, it is replaced by a new one
+        // WARNING: Adding or deleting a component moves the entity to another archetype, so the pointers to its other components
+        // (and to the components of the entity moved into its old row) are invalidated. Get them again using "getComponent"
         template<typename T>
         T* addComponent(){
             static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
-            //TODO: (Req 8) Create an component of type T, set its "owner" to be this entity, then push it into the component's list
-            // Don't forget to return a pointer to the new component
-            // Hint: You can use "new T()" to create a new component of type T
-            T* component = new T();
+            T* component = static_cast<T*>(addComponentOfType(component_types::get<T>()));
             component->owner = this;
-            components.push_back(component);
             return component;
         }
 
         // This template method searhes for a component of type T and returns a pointer to it
         // If no component of type T was found, it returns a nullptr 
+        // The type id of T is known at compile time, so this is a mask test and a lookup in the column table of the archetype
         template<typename T>
         T* getComponent(){
-            //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
-            // Return the component you found, or return null of nothing was found.
-            // static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
-            // if[T* component = dynamic_cast<T*>(component); component != nullptr]
-            //     return component;
-            // return nullptr;
-
-            for(auto& component: components){
-                T* castedComponent = dynamic_cast<T*>(component);
-                if(castedComponent != nullptr){
-                    return castedComponent;
-                }
-            }
-            return nullptr;
+            if(!(mask & componentMask<T>)) return nullptr;
+            return static_cast<T*>(archetype->getComponent(archetype->findColumn(componentTypeId<T>), row));
         }
 
-        // This template method dynami and returns a pointer to it
-        // If no component of type T was found, it returns a nullptr 
+        // This template method returns the component at the given index (the components are ordered by their type id)
+        // if it can be dynamically cast to T, otherwise it returns a nullptr
         template<typename T>
         T* getComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end())
-                return dynamic_cast<T*>(*it);
-            return nullptr;
+            if(!archetype || index >= archetype->getTypes().size()) return nullptr;
+            return dynamic_cast<T*>(getComponentInColumn(index));
         }
 
         // This template method searhes for a component of type T and deletes it
         template<typename T>
         void deleteComponent(){
-            //TODO: (Req 8) Go through the components list and find the first component that can be dynamically cast to "T*".
-            // If found, delete the found component and remove it from the components list
-            for(auto it = components.begin(); it != components.end(); it++){
-                T* castedComponent = dynamic_cast<T*>(*it);
-                if(castedComponent != nullptr){
-                    delete *it;
-                    components.erase(it);
-                    break;
-                }
-            }
+            deleteComponentOfType(componentTypeId<T>);
         }
 
-        // This template method searhes for a component of type T and deletes it
+        // This method deletes the component at the given index
         void deleteComponent(size_t index){
-            auto it = components.begin();
-            std::advance(it, index);
-            if(it != components.end()) {
-                delete *it;
-                components.erase(it);
-            }
+            if(!archetype || index >= archetype->getTypes().size()) return;
+            deleteComponentOfType(archetype->getTypes()[index]->id);
         }
 
         // This template method searhes for the given component and deletes it
         template<typename T>
         void deleteComponent(T const* component){
-            //TODO: (Req 8) Go through the components list and find the given component "component".
-            // If found, delete the found component and remove it from the components list
-            for(auto it = components.begin(); it != components.end(); it++){
-                if(*it == component){
-                    delete *it;
-                    components.erase(it);
+            if(!archetype) return;
+            for(size_t column = 0; column < archetype->getTypes().size(); column++){
+                if(getComponentInColumn(column) == component){
+                    deleteComponentOfType(archetype->getTypes()[column]->id);
                     break;
                 }
             }
@@ -114,10 +118,7 @@ namespace our {
 
         // Since the entity owns its components, they should be deleted alongside the entity
         ~Entity(){
-            //TODO: (Req 8) Delete all the components in "components".
-            for(auto& component: components){
-                delete component;
-            }
+            moveToArchetype(nullptr);
         }
 
         // Entities should not be copyable
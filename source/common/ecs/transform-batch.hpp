@@ -0,0 +1,174 @@
+#pragma once
+
+#include "transform.hpp"
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// The kernel processes 4 transforms at once using SSE2 when it is available (it is always available on x86-64)
+// Otherwise, it falls back to processing one transform at a time
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OUR_TRANSFORM_SSE2 1
+#endif
+
+namespace our {
+
+    // The transforms of many objects stored as a structure of arrays (one array per component of the position, rotation & scale)
+    // so that consecutive objects can be loaded into the lanes of a SIMD register
+    struct TransformArrays {
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<float> rotationX, rotationY, rotationZ;
+        std::vector<float> scaleX, scaleY, scaleZ;
+
+        size_t size() const { return positionX.size(); }
+
+        // The vectors keep their capacity, so clearing and refilling them every frame doesn't allocate
+        void clear(){
+            for(auto array : {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &scaleX, &scaleY, &scaleZ}) array->clear();
+        }
+
+        void push_back(const Transform& transform){
+            positionX.push_back(transform.position.x); positionY.push_back(transform.position.y); positionZ.push_back(transform.position.z);
+            rotationX.push_back(transform.rotation.x); rotationY.push_back(transform.rotation.y); rotationZ.push_back(transform.rotation.z);
+            scaleX.push_back(transform.scale.x); scaleY.push_back(transform.scale.y); scaleZ.push_back(transform.scale.z);
+        }
+    };
+
+    namespace transform_utils {
+
+        // Builds the matrix of one transform directly from the sines & cosines of its euler angles
+        // It gives the same matrix as Transform::toMat4 (translate * yawPitchRoll * scale) without the generic 4x4 products:
+        // multiplying by the scale only scales the rotation columns and multiplying by the translation only sets the last column
+        inline glm::mat4 composeMatrix(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale){
+            // Yaw (h) is around y, pitch (p) is around x and roll (b) is around z (like glm::yawPitchRoll)
+            float sh = std::sin(rotation.y), ch = std::cos(rotation.y);
+            float sp = std::sin(rotation.x), cp = std::cos(rotation.x);
+            float sb = std::sin(rotation.z), cb = std::cos(rotation.z);
+            return glm::mat4(
+                glm::vec4(ch * cb + sh * sp * sb, sb * cp, -sh * cb + ch * sp * sb, 0.0f) * scale.x,
+                glm::vec4(-ch * sb + sh * sp * cb, cb * cp, sb * sh + ch * sp * cb, 0.0f) * scale.y,
+                glm::vec4(sh * cp, -sp, ch * cp, 0.0f) * scale.z,
+                glm::vec4(position, 1.0f)
+            );
+        }
+
+        // Computes the matrices of the transforms in [begin, end) one at a time (used for the tail of the batch & when SSE2 is missing)
+        inline void toMat4BatchScalar(const TransformArrays& transforms, glm::mat4* matrices, size_t begin, size_t end){
+            for(size_t i = begin; i < end; i++){
+                matrices[i] = composeMatrix(
+                    glm::vec3(transforms.positionX[i], transforms.positionY[i], transforms.positionZ[i]),
+                    glm::vec3(transforms.rotationX[i], transforms.rotationY[i], transforms.rotationZ[i]),
+                    glm::vec3(transforms.scaleX[i], transforms.scaleY[i], transforms.scaleZ[i])
+                );
+            }
+        }
+
+#ifdef OUR_TRANSFORM_SSE2
+        // The angles larger than this (in radians) lose precision in the range reduction of "sinCos", so they are computed using std::sin & std::cos
+        constexpr float MAX_SIMD_ANGLE = 8192.0f;
+
+        // Computes the sine & cosine of 4 angles (|x| <= MAX_SIMD_ANGLE) with an error of a few ulps
+        // The angle is reduced to r in [-pi/4, pi/4] by subtracting the nearest multiple q of pi/2 (split into 3 parts so that q * part is exact),
+        // then sin(r) & cos(r) are evaluated using the minimax polynomials of the Cephes library.
+        // The quadrant (q mod 4) decides which of the two is the sine and their signs
+        inline void sinCos(__m128 x, __m128& sine, __m128& cosine){
+            __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236758134f))); // round(x * 2 / pi)
+            __m128 qf = _mm_cvtepi32_ps(q);
+            __m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(1.5703125f)));
+            r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(4.837512969970703125e-4f)));
+            r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(7.54978995489188216e-8f)));
+            __m128 r2 = _mm_mul_ps(r, r);
+
+            __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), r2), _mm_set1_ps(8.3321608736e-3f));
+            s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-1.6666654611e-1f));
+            s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+
+            __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), r2), _mm_set1_ps(-1.388731625493765e-3f));
+            c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(4.166664568298827e-2f));
+            c = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(c, r2), r2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, _mm_set1_ps(0.5f))));
+
+            // In the odd quadrants, the sine & cosine are swapped
+            __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+            __m128 sinePart = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+            __m128 cosinePart = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+            // The sine is negative in quadrants 2 & 3, and the cosine in quadrants 1 & 2 (bit 1 of q and q + 1 moved to the sign bit)
+            __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+            __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+            sine = _mm_xor_ps(sinePart, sineSign);
+            cosine = _mm_xor_ps(cosinePart, cosineSign);
+        }
+#endif
+
+        // Computes Transform::toMat4 for every transform in "transforms" and writes the results to "matrices" (which must have room for all of them)
+        // With SSE2, 4 transforms are processed at once: the 6 sines & cosines are computed for all 4 in a few instructions
+        // and every matrix element is computed for all 4 directly (like "composeMatrix"), then the results are transposed into 4 matrices.
+        // The results match toMat4 up to the rounding of the sine & cosine approximations
+        inline void toMat4Batch(const TransformArrays& transforms, glm::mat4* matrices){
+            size_t count = transforms.size();
+            size_t i = 0;
+#ifdef OUR_TRANSFORM_SSE2
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), signMask = _mm_set1_ps(-0.0f);
+            const __m128 maxAngle = _mm_set1_ps(MAX_SIMD_ANGLE);
+            for(; i + 4 <= count; i += 4){
+                __m128 rx = _mm_loadu_ps(&transforms.rotationX[i]);
+                __m128 ry = _mm_loadu_ps(&transforms.rotationY[i]);
+                __m128 rz = _mm_loadu_ps(&transforms.rotationZ[i]);
+                // Very large angles (which is rare) are handled one transform at a time
+                __m128 largest = _mm_max_ps(_mm_andnot_ps(signMask, rx), _mm_max_ps(_mm_andnot_ps(signMask, ry), _mm_andnot_ps(signMask, rz)));
+                if(_mm_movemask_ps(_mm_cmpgt_ps(largest, maxAngle)) != 0){
+                    toMat4BatchScalar(transforms, matrices, i, i + 4);
+                    continue;
+                }
+                __m128 sh, ch, sp, cp, sb, cb;
+                sinCos(ry, sh, ch);
+                sinCos(rx, sp, cp);
+                sinCos(rz, sb, cb);
+                __m128 spsb = _mm_mul_ps(sp, sb), spcb = _mm_mul_ps(sp, cb);
+
+                __m128 scaleX = _mm_loadu_ps(&transforms.scaleX[i]);
+                __m128 scaleY = _mm_loadu_ps(&transforms.scaleY[i]);
+                __m128 scaleZ = _mm_loadu_ps(&transforms.scaleZ[i]);
+                // The columns of the 4 matrices, each register has one element of one column for the 4 transforms
+                __m128 columns[4][4] = {
+                    {
+                        _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ch, cb), _mm_mul_ps(sh, spsb)), scaleX),
+                        _mm_mul_ps(_mm_mul_ps(sb, cp), scaleX),
+                        _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ch, spsb), _mm_mul_ps(sh, cb)), scaleX),
+                        zero
+                    },
+                    {
+                        _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sh, spcb), _mm_mul_ps(ch, sb)), scaleY),
+                        _mm_mul_ps(_mm_mul_ps(cb, cp), scaleY),
+                        _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sb, sh), _mm_mul_ps(ch, spcb)), scaleY),
+                        zero
+                    },
+                    {
+                        _mm_mul_ps(_mm_mul_ps(sh, cp), scaleZ),
+                        _mm_mul_ps(_mm_xor_ps(sp, signMask), scaleZ),
+                        _mm_mul_ps(_mm_mul_ps(ch, cp), scaleZ),
+                        zero
+                    },
+                    {
+                        _mm_loadu_ps(&transforms.positionX[i]),
+                        _mm_loadu_ps(&transforms.positionY[i]),
+                        _mm_loadu_ps(&transforms.positionZ[i]),
+                        one
+                    }
+                };
+                // After the transpose, register "k" has the column of the transform i + k
+                for(int column = 0; column < 4; column++){
+                    __m128* c = columns[column];
+                    _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+                    for(int k = 0; k < 4; k++) _mm_storeu_ps(&matrices[i + k][column][0], c[k]);
+                }
+            }
+#endif
+            toMat4BatchScalar(transforms, matrices, i, count);
+        }
+
+    }
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "archetype.hpp"
+
+#include <tuple>
+#include <vector>
+
+namespace our {
+
+    // A view visits the entities that have all the component types Ts (see "World::view")
+    // It only holds a reference to the list of the matching archetypes which the world keeps up to date,
+    // so creating a view is cheap and it never looks at the entities that don't match.
+    // WARNING: The entities must not add or delete components (or be deleted) while the view is visiting them,
+    // since that moves the rows that are being visited
+    template<typename... Ts>
+    class View {
+        const std::vector<Archetype*>* archetypes;
+    public:
+        explicit View(const std::vector<Archetype*>& archetypes) : archetypes(&archetypes) {}
+
+        // Calls "function(entity, components...)" for every matching entity, where the components are references to its Ts in order
+        // The components of each chunk are contiguous, so this walks over arrays instead of chasing a pointer per entity
+        template<typename Function>
+        void each(Function function) const {
+            for(Archetype* archetype : *archetypes){
+                for(size_t chunk = 0; chunk < archetype->getChunkCount(); chunk++){
+                    std::tuple<Ts*...> columns(archetype->template getColumn<Ts>(chunk)...);
+                    Entity* const* owners = archetype->getChunkEntities(chunk);
+                    size_t size = archetype->getChunkSize(chunk);
+                    for(size_t i = 0; i < size; i++) function(owners[i], std::get<Ts*>(columns)[i]...);
+                }
+            }
+        }
+
+        // Returns the number of matching entities
+        size_t size() const {
+            size_t count = 0;
+            for(Archetype* archetype : *archetypes) count += archetype->size();
+            return count;
+        }
+        bool empty() const { return size() == 0; }
+
+        // Returns the first matching entity (or null if there is none)
+        Entity* front() const {
+            for(Archetype* archetype : *archetypes){
+                if(archetype->size() > 0) return archetype->getEntity(0);
+            }
+            return nullptr;
+        }
+    };
+
+}
@@ -1,4 +1,14 @@
 #include "world.hpp"
+#include "../components/mesh-renderer.hpp"
+#include "../matrix-utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace our {
 
@@ -19,6 +29,183 @@ namespace our {
                 deserialize(entityData["children"], entity);
             }
         }
+        // The batches are built once the whole hierarchy is loaded (the world transforms depend on the parents)
+        if(parent == nullptr) buildStaticBatches();
+    }
+
+    Archetype* World::getArchetype(const std::vector<const ComponentTypeInfo*>& types){
+        ComponentMask mask = 0;
+        for(auto type : types) mask |= ComponentMask(1) << type->id;
+        auto& archetype = archetypes[mask];
+        if(!archetype){
+            archetype = std::make_unique<Archetype>(types);
+            archetypeList.push_back(archetype.get());
+            // Add the new archetype to the views that it matches
+            for(auto& [viewMask, matches] : viewMatches){
+                if((mask & viewMask) == viewMask) matches.push_back(archetype.get());
+            }
+        }
+        return archetype.get();
+    }
+
+    const std::vector<Archetype*>& World::getMatchingArchetypes(ComponentMask mask){
+        auto [it, inserted] = viewMatches.try_emplace(mask);
+        if(inserted){
+            for(Archetype* archetype : archetypeList){
+                if((archetype->getMask() & mask) == mask) it->second.push_back(archetype);
+            }
+        }
+        return it->second;
+    }
+
+    Archetype* World::getArchetypeWith(Archetype* archetype, const ComponentTypeInfo& type){
+        if(!archetype) return getArchetype({&type});
+        if(Archetype* target = archetype->addTransitions[type.id]; target) return target;
+        // Insert the new type while keeping the types sorted by their id
+        std::vector<const ComponentTypeInfo*> types = archetype->getTypes();
+        types.insert(std::upper_bound(types.begin(), types.end(), &type, [](auto first, auto second){ return first->id < second->id; }), &type);
+        Archetype* target = getArchetype(types);
+        archetype->addTransitions[type.id] = target;
+        return target;
+    }
+
+    Archetype* World::getArchetypeWithout(Archetype* archetype, ComponentTypeId id){
+        if(Archetype* target = archetype->removeTransitions[id]; target) return target;
+        std::vector<const ComponentTypeInfo*> types;
+        for(auto type : archetype->getTypes()) if(type->id != id) types.push_back(type);
+        // An entity without components has no archetype, so this transition is not cached (it is never null otherwise)
+        if(types.empty()) return nullptr;
+        Archetype* target = getArchetype(types);
+        archetype->removeTransitions[id] = target;
+        return target;
+    }
+
+    void World::buildHierarchyOrder(){
+        // The depth of an entity is the number of its ancestors, sorting by it puts every parent before its children
+        // Entities with the same depth are sorted by their address, which roughly follows the order they were allocated in,
+        // so the pass walks the memory mostly forward instead of jumping around
+        std::vector<std::pair<size_t, Entity*>> depths;
+        depths.reserve(entities.size());
+        for(auto entity : entities){
+            size_t depth = 0;
+            for(Entity* ancestor = entity->parent; ancestor != nullptr; ancestor = ancestor->parent) depth++;
+            depths.push_back({depth, entity});
+            // The order is built for the current parents, so an entity whose parent changed must update its matrices
+            if(entity->cachedParent != entity->parent){
+                entity->cachedParent = entity->parent;
+                entity->transformDirty = true;
+            }
+        }
+        std::sort(depths.begin(), depths.end(), [](const auto& first, const auto& second){
+            return first.first != second.first ? first.first < second.first : std::less<Entity*>()(first.second, second.second);
+        });
+        std::unordered_map<Entity*, int32_t> indices;
+        indices.reserve(depths.size());
+        hierarchyOrder.clear();
+        for(auto& [depth, entity] : depths){
+            indices[entity] = (int32_t)hierarchyOrder.size();
+            hierarchyOrder.push_back({entity, entity->parent ? indices[entity->parent] : -1});
+        }
+        hierarchyChanged.assign(hierarchyOrder.size(), 0);
+        hierarchyOrderDirty = false;
+    }
+
+    size_t World::updateTransforms(){
+        if(hierarchyOrderDirty) buildHierarchyOrder();
+
+        // First, find the entities whose own transform changed. Their local matrices are computed together by the batch kernel
+        changedTransforms.clear();
+        changedEntries.clear();
+        for(size_t index = 0; index < hierarchyOrder.size(); index++){
+            Entity* entity = hierarchyOrder[index].entity;
+            // If the parent of an entity changed, the order may be wrong, so it is rebuilt and the pass starts over
+            // (nothing was updated yet, so starting over is safe)
+            if(entity->parent != entity->cachedParent){
+                buildHierarchyOrder();
+                return updateTransforms();
+            }
+            bool localChanged = entity->transformDirty || entity->localTransform != entity->cachedTransform;
+            hierarchyChanged[index] = localChanged;
+            if(localChanged){
+                changedEntries.push_back((uint32_t)index);
+                changedTransforms.push_back(entity->localTransform);
+            }
+        }
+        changedMatrices.resize(changedEntries.size());
+        transform_utils::toMat4Batch(changedTransforms, changedMatrices.data());
+        for(size_t i = 0; i < changedEntries.size(); i++){
+            Entity* entity = hierarchyOrder[changedEntries[i]].entity;
+            entity->localMatrix = changedMatrices[i];
+            entity->cachedTransform = entity->localTransform;
+            entity->transformDirty = false;
+        }
+
+        // Then the world matrices are updated parents first. An entity is only visited if its local matrix or its parent's world matrix changed
+        size_t updated = 0;
+        for(size_t index = 0; index < hierarchyOrder.size(); index++){
+            auto [entity, parentIndex] = hierarchyOrder[index];
+            // The parent was visited before this entity, so we already know if its world matrix changed in this pass
+            if(!hierarchyChanged[index] && !(parentIndex >= 0 && hierarchyChanged[parentIndex])) continue;
+            hierarchyChanged[index] = 1;
+            entity->worldMatrix = parentIndex >= 0 ? entity->parent->worldMatrix * entity->localMatrix : entity->localMatrix;
+            updated++;
+        }
+        return updated;
+    }
+
+    void World::buildStaticBatches(){
+        // Group the static mesh renderers by their material and the chunk that contains their center
+        // An ordered map is used so that the batches are always built in the same order
+        using BatchKey = std::tuple<Material*, int, int, int>;
+        // The entities are stored instead of their mesh renderers since deleting a component moves the rows of the other entities
+        std::map<BatchKey, std::vector<Entity*>> groups;
+        for(auto entity : entities){
+            MeshRendererComponent* renderer = entity->getComponent<MeshRendererComponent>();
+            if(!renderer || !renderer->isStatic || !renderer->mesh || !renderer->material) continue;
+            // Transparent objects must be sorted one by one, and the objects with levels of detail or used as occluders need their own mesh
+            if(renderer->material->transparent || !renderer->lods.empty() || renderer->occluder) continue;
+            glm::vec3 center = renderer->mesh->getAABB().transform(entity->getLocalToWorldMatrix()).getCenter();
+            glm::ivec3 chunk = glm::ivec3(glm::floor(center / staticChunkSize));
+            groups[{renderer->material, chunk.x, chunk.y, chunk.z}].push_back(entity);
+        }
+
+        for(auto& [key, members] : groups){
+            // Merging a single object gains nothing
+            if(members.size() < 2) continue;
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> elements;
+            for(auto member : members){
+                MeshRendererComponent* renderer = member->getComponent<MeshRendererComponent>();
+                glm::mat4 localToWorld = member->getLocalToWorldMatrix();
+                glm::mat3 normalMatrix = matrix_utils::normalMatrix(localToWorld);
+                // A transformation with a negative determinant mirrors the mesh, so the triangles are reversed to keep them counter clockwise
+                bool mirrored = glm::determinant(glm::mat3(localToWorld)) < 0;
+                unsigned int base = (unsigned int)vertices.size();
+                for(Vertex vertex : renderer->mesh->readVertices()){
+                    vertex.position = glm::vec3(localToWorld * glm::vec4(vertex.position, 1.0f));
+                    glm::vec3 normal = normalMatrix * vertex.normal;
+                    float length = glm::length(normal);
+                    if(length > 0) vertex.normal = normal / length;
+                    vertices.push_back(vertex);
+                }
+                std::vector<unsigned int> meshElements = renderer->mesh->readElements();
+                for(size_t i = 0; i + 2 < meshElements.size(); i += 3){
+                    elements.push_back(base + meshElements[i]);
+                    elements.push_back(base + meshElements[mirrored ? i + 2 : i + 1]);
+                    elements.push_back(base + meshElements[mirrored ? i + 1 : i + 2]);
+                }
+                member->deleteComponent<MeshRendererComponent>();
+            }
+
+            // The merged mesh is already in the world space, so the batch entity has the identity transform
+            Entity* batch = add();
+            batch->name = "static-batch";
+            batch->parent = nullptr;
+            MeshRendererComponent* renderer = batch->addComponent<MeshRendererComponent>();
+            renderer->ownedMesh = std::make_unique<Mesh>(vertices, elements);
+            renderer->mesh = renderer->ownedMesh.get();
+            renderer->material = std::get<0>(key);
+        }
     }
 
 }
\ No newline at end of file
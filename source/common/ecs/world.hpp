@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "entity.hpp"
+#include "view.hpp"
+#include "transform-batch.hpp"
 
 namespace our {
 
@@ -10,15 +16,58 @@ namespace our {
         std::unordered_set<Entity*> entities; // These are the entities held by this world
         std::unordered_set<Entity*> markedForRemoval; // These are the entities that are awaiting to be deleted
                                                       // when deleteMarkedEntities is called
+        // The archetypes that store the components of the entities, keyed by the mask of their component types
+        std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> archetypes;
+        std::vector<Archetype*> archetypeList; // The archetypes in the order they were created (to iterate over them quickly)
+
+        // Returns the archetype with the given component types (sorted by their id), it is created if it doesn't exist
+        Archetype* getArchetype(const std::vector<const ComponentTypeInfo*>& types);
+        // Returns the archetype an entity moves to when it adds/removes a component type (null if it would have no components)
+        Archetype* getArchetypeWith(Archetype* archetype, const ComponentTypeInfo& type);
+        Archetype* getArchetypeWithout(Archetype* archetype, ComponentTypeId id);
+        friend Entity; // The entities ask the world for the archetypes when their components change
+
+        // The archetypes that match each mask requested by a view. When an archetype is created, it is added to the lists it matches,
+        // so the lists are kept up to date without searching all the archetypes (or entities) every time a view is created.
+        // The map is node based, so the lists never move and the views can keep references to them
+        std::unordered_map<ComponentMask, std::vector<Archetype*>> viewMatches;
+        // Returns the list of the archetypes that have all the component types in "mask" (it is built the first time the mask is requested)
+        const std::vector<Archetype*>& getMatchingArchetypes(ComponentMask mask);
+
+        // The entities sorted by their depth in the hierarchy, so every parent comes before its children (see "updateTransforms")
+        // Each entry has the index of the parent's entry (or -1) so that the pass doesn't have to visit the parent to know if it changed
+        // It is rebuilt when entities are added or removed or when the parent of an entity changes
+        struct HierarchyNode {
+            Entity* entity;
+            int32_t parent;
+        };
+        std::vector<HierarchyNode> hierarchyOrder;
+        std::vector<uint8_t> hierarchyChanged; // For each entry, whether its world matrix changed in the current pass
+        // The transforms that changed since the last pass, their entries in "hierarchyOrder" and their new local matrices
+        // They are kept between frames so that the pass doesn't allocate once they are big enough
+        TransformArrays changedTransforms;
+        std::vector<uint32_t> changedEntries;
+        std::vector<glm::mat4> changedMatrices;
+        bool hierarchyOrderDirty = true;
+        void buildHierarchyOrder();
     public:
+        // The size of the cubic cells into which the static objects are grouped when they are merged (see "buildStaticBatches")
+        // Each cell is merged into its own mesh so that the batches that are outside the camera frustum can still be culled
+        float staticChunkSize = 32.0f;
 
         World() = default;
 
         // This will deserialize a json array of entities and add the new entities to the current world
         // If parent pointer is not null, the new entities will be have their parent set to that given pointer
         // If any of the entities has children, this function will be called recursively for these children
+        // After all the entities are added, the static mesh renderers are merged into batches
         void deserialize(const nlohmann::json& data, Entity* parent = nullptr);
 
+        // Merges the static mesh renderers that share a material and lie in the same chunk into one mesh (transformed to the world space)
+        // The merged mesh is drawn by a new entity and the mesh renderers of the merged objects are removed (their other components are kept)
+        // This way, each chunk needs one draw call per material instead of one draw call per object
+        void buildStaticBatches();
+
         // This adds an entity to the entities set and returns a pointer to that entity
         // WARNING The entity is owned by this world so don't use "delete" to delete it, instead, call "markForRemoval"
         // to put it in the "markedForRemoval" set. The elements in the "markedForRemoval" set will be removed and
@@ -29,6 +78,7 @@ namespace our {
             Entity* entity = new Entity();
             entity->world = this;
             entities.insert(entity);
+            hierarchyOrderDirty = true;
             return entity;
         }
 
@@ -37,6 +87,30 @@ namespace our {
             return entities;
         }
 
+        // Updates the cached local & world matrices of the entities whose transform (or an ancestor's transform) changed
+        // It should be called once per frame after the systems changed the transforms (the renderer calls it before extracting the commands)
+        // The entities are visited parents first, and an entity only rebuilds its world matrix if its transform or its parent's world matrix changed.
+        // So a deep hierarchy costs a comparison per entity and a matrix product per changed entity, instead of rebuilding
+        // the whole parent chain every time "getLocalToWorldMatrix" is called
+        // After this pass (and until a transform changes), "getLocalToWorldMatrix" returns the cached matrix without writing anything,
+        // so it is safe to call from the worker threads
+        // Returns the number of world matrices that were recomputed
+        size_t updateTransforms();
+
+        // Returns all the archetypes created in this world (some of them may be empty)
+        const std::vector<Archetype*>& getArchetypes() const {
+            return archetypeList;
+        }
+
+        // Returns a view of the entities that have all the component types Ts, for example:
+        //     world->view<MovementComponent>().each([](Entity* entity, MovementComponent& movement){ ... });
+        // The view only visits the matching entities, so it is much faster than looping over "getEntities" and calling "getComponent"
+        template<typename... Ts>
+        View<Ts...> view(){
+            static_assert(sizeof...(Ts) > 0, "A view needs at least one component type");
+            return View<Ts...>(getMatchingArchetypes((componentMask<Ts> | ...)));
+        }
+
         // This marks an entity for removal by adding it to the "markedForRemoval" set.
         // The elements in the "markedForRemoval" set will be removed and deleted when "deleteMarkedEntities" is called.
         void markForRemoval(Entity* entity){
@@ -54,6 +128,7 @@ namespace our {
                 entities.erase(entity);
                 delete entity;
             }
+            if(!markedForRemoval.empty()) hierarchyOrderDirty = true;
             markedForRemoval.clear();
         }
 
@@ -65,6 +140,8 @@ namespace our {
             }
             entities.clear();
             markedForRemoval.clear();
+            hierarchyOrder.clear();
+            hierarchyOrderDirty = true;
         }
 
         //Since the world owns all of its entities, they should be deleted alongside it.
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace our {
+
+    // A fixed capacity list whose storage is allocated from a FrameArena
+    // It is only valid until the arena is reset, so it should never be kept across frames
+    // Since the arena never calls destructors, the items must be trivially destructible
+    template<typename T>
+    class FrameList {
+        static_assert(std::is_trivially_destructible_v<T>, "FrameList items must be trivially destructible");
+        T* items = nullptr;
+        size_t count = 0, capacity = 0;
+    public:
+        FrameList() = default;
+        FrameList(T* storage, size_t capacity) : items(storage), capacity(capacity) {}
+
+        // Adds an item to the end of the list. The caller must make sure that the list is not full
+        T& push_back(const T& item){ return *new (&items[count++]) T(item); }
+        void clear(){ count = 0; }
+        // Keeps the first "newSize" items (it can only shrink the list, e.g. after removing items in place)
+        void truncate(size_t newSize){ if(newSize < count) count = newSize; }
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        bool full() const { return count == capacity; }
+
+        T* data() { return items; }
+        const T* data() const { return items; }
+        T& operator[](size_t index) { return items[index]; }
+        const T& operator[](size_t index) const { return items[index]; }
+        T* begin() { return items; }
+        T* end() { return items + count; }
+        const T* begin() const { return items; }
+        const T* end() const { return items + count; }
+    };
+
+    // A linear (bump) allocator for the data that only lives for a single frame (e.g. the render commands)
+    // Allocating is just moving an offset forward and nothing is freed individually, instead the whole arena is reset at the start of the next frame
+    // If a frame needs more memory than the arena has, extra blocks are allocated from the heap. Then on the next reset,
+    // all the blocks are merged into one block that is big enough for the whole frame, so in the steady state the arena never touches the heap
+    class FrameArena {
+        struct Block {
+            std::unique_ptr<std::byte[]> memory;
+            size_t size;
+        };
+        std::vector<Block> blocks;
+        // The index of the block we are allocating from and the offset of the first free byte in it
+        size_t currentBlock = 0, offset = 0;
+        // The number of bytes allocated since the last reset
+        size_t usedBytes = 0;
+        // The number of times the arena allocated memory from the heap since it was created
+        uint64_t heapAllocations = 0;
+
+        void addBlock(size_t size){
+            blocks.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+            heapAllocations++;
+        }
+
+    public:
+        explicit FrameArena(size_t initialSize = 64 * 1024){
+            addBlock(initialSize);
+        }
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        // Returns "size" bytes of memory aligned to "alignment" (which must be a power of 2)
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)){
+            while(true){
+                Block& block = blocks[currentBlock];
+                uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+                size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+                if(aligned + size <= block.size){
+                    offset = aligned + size;
+                    usedBytes += size;
+                    return block.memory.get() + aligned;
+                }
+                // This block is full, so we move to the next one (and create it if it doesn't exist)
+                if(currentBlock + 1 == blocks.size()) addBlock(std::max(block.size * 2, size + alignment));
+                currentBlock++;
+                offset = 0;
+            }
+        }
+
+        // Allocates an uninitialized array of "count" items of type T
+        template<typename T>
+        T* allocateArray(size_t count){
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        // Allocates an empty list that can hold up to "capacity" items
+        template<typename T>
+        FrameList<T> allocateList(size_t capacity){
+            return FrameList<T>(allocateArray<T>(capacity), capacity);
+        }
+
+        // Frees everything allocated since the last reset. All the pointers and lists allocated from the arena become invalid
+        void reset(){
+            if(blocks.size() > 1){
+                // The last frame did not fit in one block, so we replace all the blocks with one block that can hold all of them
+                size_t totalSize = 0;
+                for(auto& block : blocks) totalSize += block.size;
+                blocks.clear();
+                addBlock(totalSize);
+            }
+            currentBlock = 0;
+            offset = 0;
+            usedBytes = 0;
+        }
+
+        size_t getUsedBytes() const { return usedBytes; }
+        size_t getCapacity() const {
+            size_t capacity = 0;
+            for(auto& block : blocks) capacity += block.size;
+            return capacity;
+        }
+        // The number of heap allocations made by the arena since it was created (it should stop increasing after the first few frames)
+        uint64_t getHeapAllocations() const { return heapAllocations; }
+    };
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+namespace our {
+
+    // The number of state changes that were sent to OpenGL and the number of state changes that were skipped since they were redundant
+    struct GLStateCounters {
+        uint32_t issued = 0;
+        uint32_t skipped = 0;
+    };
+
+    // The values that the GLStateCache believes are currently applied to OpenGL (UNKNOWN means that the next call must be issued)
+    struct GLStateShadow {
+        static constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+        static constexpr int MAX_TEXTURE_UNITS = 32;
+
+        GLuint cullFaceEnabled = UNKNOWN, depthTestEnabled = UNKNOWN, blendEnabled = UNKNOWN;
+        GLuint culledFace = UNKNOWN, frontFace = UNKNOWN;
+        GLuint depthFunction = UNKNOWN;
+        GLuint blendEquation = UNKNOWN, blendSourceFactor = UNKNOWN, blendDestinationFactor = UNKNOWN;
+        bool blendColorKnown = false;
+        glm::vec4 blendColor = glm::vec4(0.0f);
+        GLuint colorMask = UNKNOWN, depthMask = UNKNOWN;
+        GLuint activeTextureUnit = UNKNOWN;
+        GLuint textures[MAX_TEXTURE_UNITS];
+        GLuint samplers[MAX_TEXTURE_UNITS];
+        GLuint vertexArray = UNKNOWN;
+        GLuint program = UNKNOWN;
+
+        GLStateShadow(){
+            for(int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) textures[unit] = samplers[unit] = UNKNOWN;
+        }
+    };
+
+    // This static class shadows a subset of the OpenGL state (pipeline options, texture & sampler bindings, vertex array and program)
+    // Every state change in the engine should go through it, so that it can remember what is currently applied
+    // and only call OpenGL when the requested value differs from the current one.
+    // WARNING: If some code changes the state by calling OpenGL directly, the cache will not know about it.
+    // In this case, call "invalidate" so that the next call for every state is sent to OpenGL.
+    class GLStateCache {
+    public:
+        using Counters = GLStateCounters;
+
+        // If false, the cache sends every call to OpenGL (useful to check that a rendering issue is not caused by the cache)
+        static inline bool enabled = true;
+
+    private:
+        // We use this value to mark a state as unknown, so that the next call is always issued
+        static constexpr GLuint UNKNOWN = GLStateShadow::UNKNOWN;
+        static constexpr int MAX_TEXTURE_UNITS = GLStateShadow::MAX_TEXTURE_UNITS;
+        using State = GLStateShadow;
+
+        static inline State state;
+        static inline Counters counters, lastFrameCounters;
+
+        // Updates the cached value and returns true if the call should be sent to OpenGL
+        static bool change(GLuint& current, GLuint value){
+            if(enabled && current == value){
+                counters.skipped++;
+                return false;
+            }
+            current = value;
+            counters.issued++;
+            return true;
+        }
+
+        // Returns the cached value of the capability or null if the cache doesn't track it
+        static GLuint* capability(GLenum cap){
+            switch(cap){
+                case GL_CULL_FACE: return &state.cullFaceEnabled;
+                case GL_DEPTH_TEST: return &state.depthTestEnabled;
+                case GL_BLEND: return &state.blendEnabled;
+                default: return nullptr;
+            }
+        }
+
+    public:
+        // Enables or disables a capability. Only GL_CULL_FACE, GL_DEPTH_TEST & GL_BLEND are cached,
+        // any other capability (e.g. GL_SCISSOR_TEST) is always sent to OpenGL
+        static void setCapability(GLenum cap, bool value){
+            GLuint* current = capability(cap);
+            if(current == nullptr || change(*current, value)){
+                if(value) glEnable(cap); else glDisable(cap);
+            }
+        }
+
+        static void cullFace(GLenum face){
+            if(change(state.culledFace, face)) glCullFace(face);
+        }
+
+        static void frontFace(GLenum winding){
+            if(change(state.frontFace, winding)) glFrontFace(winding);
+        }
+
+        static void depthFunc(GLenum function){
+            if(change(state.depthFunction, function)) glDepthFunc(function);
+        }
+
+        static void blendEquation(GLenum equation){
+            if(change(state.blendEquation, equation)) glBlendEquation(equation);
+        }
+
+        static void blendFunc(GLenum sourceFactor, GLenum destinationFactor){
+            // Both factors are sent by one call so we issue it if any of them changed
+            if(enabled && state.blendSourceFactor == sourceFactor && state.blendDestinationFactor == destinationFactor){
+                counters.skipped++;
+                return;
+            }
+            state.blendSourceFactor = sourceFactor;
+            state.blendDestinationFactor = destinationFactor;
+            counters.issued++;
+            glBlendFunc(sourceFactor, destinationFactor);
+        }
+
+        static void blendColor(const glm::vec4& color){
+            if(enabled && state.blendColorKnown && state.blendColor == color){
+                counters.skipped++;
+                return;
+            }
+            state.blendColorKnown = true;
+            state.blendColor = color;
+            counters.issued++;
+            glBlendColor(color.r, color.g, color.b, color.a);
+        }
+
+        static void colorMask(const glm::bvec4& mask){
+            GLuint packed = (mask.r ? 1 : 0) | (mask.g ? 2 : 0) | (mask.b ? 4 : 0) | (mask.a ? 8 : 0);
+            if(change(state.colorMask, packed)) glColorMask(mask.r, mask.g, mask.b, mask.a);
+        }
+
+        static void depthMask(bool mask){
+            if(change(state.depthMask, mask)) glDepthMask(mask);
+        }
+
+        // Selects the active texture unit, "unit" is the index of the unit (e.g. 0 for GL_TEXTURE0)
+        static void activeTexture(GLuint unit){
+            if(change(state.activeTextureUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+        }
+
+        // Binds the given texture to GL_TEXTURE_2D in the active texture unit
+        static void bindTexture(GLuint texture){
+            GLuint unit = state.activeTextureUnit;
+            if(unit >= MAX_TEXTURE_UNITS){
+                // We don't know the active unit so we cannot know what is bound to it
+                counters.issued++;
+                glBindTexture(GL_TEXTURE_2D, texture);
+                return;
+            }
+            if(change(state.textures[unit], texture)) glBindTexture(GL_TEXTURE_2D, texture);
+        }
+
+        static void bindSampler(GLuint unit, GLuint sampler){
+            if(unit >= MAX_TEXTURE_UNITS){
+                counters.issued++;
+                glBindSampler(unit, sampler);
+                return;
+            }
+            if(change(state.samplers[unit], sampler)) glBindSampler(unit, sampler);
+        }
+
+        static void bindVertexArray(GLuint vertexArray){
+            if(change(state.vertexArray, vertexArray)) glBindVertexArray(vertexArray);
+        }
+
+        static void useProgram(GLuint program){
+            if(change(state.program, program)) glUseProgram(program);
+        }
+
+        // When an object is deleted, OpenGL unbinds it and its name could be reused by a new object.
+        // So these functions should be called before deleting an object to make sure that the cache doesn't think it is still bound.
+        static void forgetTexture(GLuint texture){
+            for(auto& bound : state.textures) if(bound == texture) bound = UNKNOWN;
+        }
+        static void forgetSampler(GLuint sampler){
+            for(auto& bound : state.samplers) if(bound == sampler) bound = UNKNOWN;
+        }
+        static void forgetVertexArray(GLuint vertexArray){
+            if(state.vertexArray == vertexArray) state.vertexArray = UNKNOWN;
+        }
+        static void forgetProgram(GLuint program){
+            if(state.program == program) state.program = UNKNOWN;
+        }
+
+        // Marks all the states as unknown, so the next call for every state will be sent to OpenGL
+        static void invalidate(){
+            state = State();
+        }
+
+        // Should be called at the start of every frame. It saves the counters of the frame that just ended then resets them.
+        // It also invalidates the cache since other libraries (e.g. ImGui) may have changed the state without going through the cache
+        static void newFrame(){
+            lastFrameCounters = counters;
+            counters = Counters();
+            invalidate();
+        }
+
+        // Returns the counters of the last completed frame
+        static const Counters& getLastFrameCounters(){ return lastFrameCounters; }
+    };
+
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <json/json.hpp>
+#include <imgui.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace our {
+
+    // A handle to a profiling scope (see "GpuProfiler::registerScope")
+    struct GpuScopeId {
+        uint32_t index;
+    };
+
+    // This static class measures how long the GPU spends on parts of a frame (scopes) using timer queries
+    // Each scope writes a GL_TIMESTAMP query when it begins and another one when it ends, so scopes can be nested.
+    // Reading a query right after issuing it would stall the CPU until the GPU finishes the frame,
+    // so every scope has a ring of queries (one slot per frame) and a slot is only read when it is about to be reused (LATENCY frames later).
+    // Timer queries are core since OpenGL 3.3, so this works with any driver that gives us our context (including Mesa llvmpipe)
+    class GpuProfiler {
+    public:
+        // The number of frames between issuing a query and reading its result
+        static constexpr int LATENCY = 4;
+        // The number of samples (frames) kept for every scope to compute the statistics
+        static constexpr size_t HISTORY = 1024;
+
+        // The statistics of a scope over the kept samples (in milliseconds)
+        struct Statistics {
+            size_t samples = 0;
+            double average = 0, median = 0, p95 = 0, p99 = 0, max = 0;
+        };
+
+    private:
+        struct Scope {
+            std::string name;
+            // For every slot in the ring, the queries of the beginning and the end of the scope
+            GLuint queries[LATENCY][2] = {};
+            bool pending[LATENCY] = {};
+            // A ring of the last measured durations (in milliseconds)
+            std::vector<double> history;
+            size_t next = 0;
+        };
+        static inline std::vector<Scope> scopes;
+        static inline bool enabled = false;
+        static inline int slot = 0;
+
+        // Reads the result of the given slot if it is ready. If the GPU is still more than LATENCY frames behind, the sample is dropped
+        static void collect(Scope& scope, int slot){
+            if(!scope.pending[slot]) return;
+            scope.pending[slot] = false;
+            GLuint available = 0;
+            glGetQueryObjectuiv(scope.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available) return;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(scope.queries[slot][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(scope.queries[slot][1], GL_QUERY_RESULT, &end);
+            double milliseconds = end > begin ? (end - begin) * 1e-6 : 0.0;
+            if(scope.history.size() < HISTORY) scope.history.push_back(milliseconds);
+            else scope.history[scope.next] = milliseconds;
+            scope.next = (scope.next + 1) % HISTORY;
+        }
+
+    public:
+        // The path of the JSON report written at exit (if empty, no report is written)
+        static inline std::string reportPath;
+
+        // The profiler is disabled by default, so the scopes cost nothing unless it is enabled
+        static void setEnabled(bool value){ enabled = value; }
+        static bool isEnabled(){ return enabled; }
+
+        // Returns the id of the scope with the given name (it is created the first time the name is seen)
+        // The ids should be registered once (e.g. when initializing) and stored. The queries are created the first time the scope is used
+        static GpuScopeId registerScope(const std::string& name){
+            for(uint32_t index = 0; index < scopes.size(); index++){
+                if(scopes[index].name == name) return {index};
+            }
+            scopes.emplace_back();
+            scopes.back().name = name;
+            return {(uint32_t)scopes.size() - 1};
+        }
+
+        // Should be called once at the start of every frame (before any scope begins)
+        // It moves to the next slot in the ring and collects the results that were issued in it LATENCY frames ago
+        static void beginFrame(){
+            if(!enabled) return;
+            slot = (slot + 1) % LATENCY;
+            for(auto& scope : scopes) collect(scope, slot);
+        }
+
+        // Each scope should begin & end at most once per frame (a second pair in the same frame replaces the first one)
+        static void begin(GpuScopeId id){
+            if(!enabled) return;
+            Scope& scope = scopes[id.index];
+            if(scope.queries[0][0] == 0) glGenQueries(LATENCY * 2, &scope.queries[0][0]);
+            glQueryCounter(scope.queries[slot][0], GL_TIMESTAMP);
+        }
+
+        static void end(GpuScopeId id){
+            if(!enabled) return;
+            Scope& scope = scopes[id.index];
+            if(scope.queries[0][0] == 0) return;
+            glQueryCounter(scope.queries[slot][1], GL_TIMESTAMP);
+            scope.pending[slot] = true;
+        }
+
+        // Begins a scope when constructed and ends it when destroyed
+        class ScopedTimer {
+            GpuScopeId id;
+        public:
+            explicit ScopedTimer(GpuScopeId id) : id(id) { GpuProfiler::begin(id); }
+            ~ScopedTimer(){ GpuProfiler::end(id); }
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+        };
+
+        // Computes the statistics of the given scope over its kept samples
+        static Statistics getStatistics(GpuScopeId id){
+            const std::vector<double>& history = scopes[id.index].history;
+            Statistics statistics;
+            statistics.samples = history.size();
+            if(history.empty()) return statistics;
+            std::vector<double> sorted = history;
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&](double fraction){ return sorted[std::min(sorted.size() - 1, (size_t)(fraction * (sorted.size() - 1) + 0.5))]; };
+            double total = 0;
+            for(double sample : sorted) total += sample;
+            statistics.average = total / sorted.size();
+            statistics.median = percentile(0.5);
+            statistics.p95 = percentile(0.95);
+            statistics.p99 = percentile(0.99);
+            statistics.max = sorted.back();
+            return statistics;
+        }
+
+        // Returns the names & ids of all the registered scopes
+        static std::vector<std::pair<std::string, GpuScopeId>> getScopes(){
+            std::vector<std::pair<std::string, GpuScopeId>> result;
+            for(uint32_t index = 0; index < scopes.size(); index++) result.push_back({scopes[index].name, {index}});
+            return result;
+        }
+
+        // Returns the statistics of all the scopes that have samples as a JSON object (the times are in milliseconds)
+        static nlohmann::json toJson(){
+            nlohmann::json report = nlohmann::json::object();
+            for(auto& [name, id] : getScopes()){
+                Statistics statistics = getStatistics(id);
+                if(statistics.samples == 0) continue;
+                report[name] = {
+                    {"samples", statistics.samples},
+                    {"average", statistics.average},
+                    {"median", statistics.median},
+                    {"p95", statistics.p95},
+                    {"p99", statistics.p99},
+                    {"max", statistics.max}
+                };
+            }
+            return report;
+        }
+
+        // Writes the statistics of all the scopes to the given JSON file
+        static bool writeJson(const std::string& path){
+            std::ofstream file(path);
+            if(!file){
+                std::cerr << "Couldn't write the GPU profile to: " << path << std::endl;
+                return false;
+            }
+            file << toJson().dump(4) << std::endl;
+            return true;
+        }
+
+        // Shows the statistics of all the scopes in an ImGui window (if the profiler is enabled)
+        static void onImmediateGui(){
+            if(!enabled) return;
+            ImGui::Begin("GPU Profiler");
+            ImGui::Text("%-24s %8s %8s %8s %8s", "scope (ms)", "avg", "median", "p95", "p99");
+            for(auto& [name, id] : getScopes()){
+                Statistics statistics = getStatistics(id);
+                ImGui::Text("%-24s %8.3f %8.3f %8.3f %8.3f", name.c_str(), statistics.average, statistics.median, statistics.p95, statistics.p99);
+            }
+            ImGui::End();
+        }
+
+        // Deletes the queries of all the scopes (it should be called before the OpenGL context is destroyed)
+        static void destroy(){
+            for(auto& scope : scopes){
+                if(scope.queries[0][0] != 0) glDeleteQueries(LATENCY * 2, &scope.queries[0][0]);
+                for(int i = 0; i < LATENCY; i++){
+                    scope.queries[i][0] = scope.queries[i][1] = 0;
+                    scope.pending[i] = false;
+                }
+            }
+        }
+    };
+
+}
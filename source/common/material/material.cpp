@@ -10,6 +10,7 @@ namespace our {
         //TODO: (Req 7) Write this function
         pipelineState.setup();
         shader->use();
+        setupParameters(shader);
     }
 
     // This function read the material data from a json object
@@ -21,14 +22,19 @@ namespace our {
         }
         shader = AssetLoader<ShaderProgram>::get(data["shader"].get<std::string>());
         transparent = data.value("transparent", false);
+        if(data.contains("instancedShader")){
+            instancedShader = AssetLoader<ShaderProgram>::get(data["instancedShader"].get<std::string>());
+        }
     }
 
-    // This function should call the setup of its parent and
+    // This function should call the setupParameters of its parent and
     // set the "tint" uniform to the value in the member variable tint 
-    void TintedMaterial::setup() const {
+    void TintedMaterial::setupParameters(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
-        Material::setup();
-        shader->set("tint", tint);
+        Material::setupParameters(program);
+        // The uniform names are interned once (the first time this function is called)
+        static const UniformId tintId = ShaderProgram::intern("tint");
+        program->set(tintId, tint);
     }
 
     // This function read the material data from a json object
@@ -38,17 +44,19 @@ namespace our {
         tint = data.value("tint", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
     }
 
-    // This function should call the setup of its parent and
+    // This function should call the setupParameters of its parent and
     // set the "alphaThreshold" uniform to the value in the member variable alphaThreshold
     // Then it should bind the texture and sampler to a texture unit and send the unit number to the uniform variable "tex" 
-    void TexturedMaterial::setup() const {
+    void TexturedMaterial::setupParameters(ShaderProgram* program) const {
         //TODO: (Req 7) Write this function
-        TintedMaterial::setup();
-        shader->set("alphaThreshold", alphaThreshold);
-        glActiveTexture(GL_TEXTURE0);
+        TintedMaterial::setupParameters(program);
+        static const UniformId alphaThresholdId = ShaderProgram::intern("alphaThreshold");
+        static const UniformId texId = ShaderProgram::intern("tex");
+        program->set(alphaThresholdId, alphaThreshold);
+        GLStateCache::activeTexture(0);
         if(texture){texture->bind();}
         if(sampler){sampler->bind(0);}
-        shader->set("tex", 0);
+        program->set(texId, 0);
         
     }
 
@@ -61,40 +69,46 @@ namespace our {
         sampler = AssetLoader<Sampler>::get(data.value("sampler", ""));
     }
 
-    void LitMaterial::setup() const {
+    void LitMaterial::setupParameters(ShaderProgram* program) const {
         
-        Material::setup();
-        shader->set("alphaThreshold", alphaThreshold);
+        Material::setupParameters(program);
+        static const UniformId alphaThresholdId = ShaderProgram::intern("alphaThreshold");
+        static const UniformId textureIds[] = {
+            ShaderProgram::intern("material.albedo_tex"), ShaderProgram::intern("material.specular_tex"),
+            ShaderProgram::intern("material.roughness_tex"), ShaderProgram::intern("material.ao_tex"),
+            ShaderProgram::intern("material.emission_tex")
+        };
+        program->set(alphaThresholdId, alphaThreshold);
         
-        glActiveTexture(GL_TEXTURE0);
+        GLStateCache::activeTexture(0);
         if(albedo_tex) albedo_tex->bind();
         else Texture2D::unbind();
         sampler->bind(0);
-        shader->set("material.albedo_tex", 0);
+        program->set(textureIds[0], 0);
 
-        glActiveTexture(GL_TEXTURE1);
+        GLStateCache::activeTexture(1);
         if(specular_tex) specular_tex->bind();
         else Texture2D::unbind();
         sampler->bind(1);
-        shader->set("material.specular_tex", 1);
+        program->set(textureIds[1], 1);
 
-        glActiveTexture(GL_TEXTURE2);
+        GLStateCache::activeTexture(2);
         if(roughness_tex) roughness_tex->bind();
         else Texture2D::unbind();
         sampler->bind(2);
-        shader->set("material.roughness_tex", 2);
+        program->set(textureIds[2], 2);
 
-        glActiveTexture(GL_TEXTURE3);
+        GLStateCache::activeTexture(3);
         if(ao_tex) ao_tex->bind();
         else Texture2D::unbind();
         sampler->bind(3);
-        shader->set("material.ao_tex", 3);
+        program->set(textureIds[3], 3);
 
-        glActiveTexture(GL_TEXTURE4);
+        GLStateCache::activeTexture(4);
         if(emission_tex) emission_tex->bind();
         else Texture2D::unbind();
         sampler->bind(4);
-        shader->set("material.emission_tex", 4);
+        program->set(textureIds[4], 4);
     }
 
     void LitMaterial::deserialize(const nlohmann::json& data){
@@ -17,13 +17,31 @@ namespace our {
     // 3- Whether this material is transparent or not
     // Materials that send uniforms to the shader should inherit from the is material and add the required uniforms
     class Material {
+        // A counter used to give each created material a unique id
+        static inline uint32_t nextId = 0;
+        uint32_t id;
     public:
         PipelineState pipelineState;
         ShaderProgram* shader;
+        // An optional variant of "shader" that reads the object transforms from per-instance attributes instead of uniforms
+        // If it exists, the renderer can draw many objects using this material & the same mesh by a single instanced draw call
+        ShaderProgram* instancedShader = nullptr;
         bool transparent;
+
+        Material() : id(nextId++) {}
+
+        // Returns a small unique integer that identifies this material
+        // The renderer uses it to group the draws that share the same material next to each other
+        uint32_t getId() const { return id; }
         
-        // This function does 2 things: setup the pipeline state and set the shader program to be used
-        virtual void setup() const;
+        // This function does 3 things: setup the pipeline state, set the shader program to be used
+        // and send the material parameters to the shader (by calling "setupParameters")
+        void setup() const;
+        // This function sends the uniforms & binds the textures of this material to the given program (which should be already in use)
+        // The program is either "shader" or "instancedShader" since they read the same material parameters
+        // Materials that send uniforms to the shader should override this function instead of "setup"
+        // This allows the renderer to skip the pipeline state and the shader when they did not change between two draws
+        virtual void setupParameters(ShaderProgram*) const {}
         // This function read a material from a json object
         virtual void deserialize(const nlohmann::json& data);
     };
@@ -34,7 +52,7 @@ namespace our {
     public:
         glm::vec4 tint;
 
-        void setup() const override;
+        void setupParameters(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
@@ -49,7 +67,7 @@ namespace our {
         Sampler* sampler;
         float alphaThreshold;
 
-        void setup() const override;
+        void setupParameters(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
@@ -63,7 +81,7 @@ namespace our {
         Sampler* sampler;
         float alphaThreshold;
 
-        void setup() const override;
+        void setupParameters(ShaderProgram* program) const override;
         void deserialize(const nlohmann::json& data) override;
     };
 
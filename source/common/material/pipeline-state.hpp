@@ -1,7 +1,9 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state-cache.hpp"
 #include <glm/vec4.hpp>
+#include <glm/gtx/hash.hpp>
 #include <json/json.hpp>
 
 namespace our {
@@ -40,58 +42,100 @@ namespace our {
 
         // This function should set the OpenGL options to the values specified by this structure
         // For example, if faceCulling.enabled is true, you should call glEnable(GL_CULL_FACE), otherwise, you should call glDisable(GL_CULL_FACE)
+        // All the calls go through the GLStateCache, so only the options that differ from the current OpenGL state are sent to the driver
         void setup() const {
             //TODO: (Req 4) Write this function
             if (faceCulling.enabled) {
-                glEnable(GL_CULL_FACE);
+                GLStateCache::setCapability(GL_CULL_FACE, true);
 
                 // glCullFace is used to specify which face will not be drawn
-                glCullFace(faceCulling.culledFace);
+                GLStateCache::cullFace(faceCulling.culledFace);
 
                 // glFrontFace Specifies the orientation of front-facing polygons
                 // e.g. GL_CCW specifies that the front-facing polygons are counter-clockwise
-                glFrontFace(faceCulling.frontFace);
+                GLStateCache::frontFace(faceCulling.frontFace);
             }
             else {
-                glDisable(GL_CULL_FACE);
+                GLStateCache::setCapability(GL_CULL_FACE, false);
             }
 
             if (depthTesting.enabled) {
-                glEnable(GL_DEPTH_TEST);
+                GLStateCache::setCapability(GL_DEPTH_TEST, true);
 
                 // glDepthFunc Specifies the depth comparison function that determines which fragments are drawn
                 // e.g  GL_LESS will draw a fragment if its depth value is less than the depth value stored in the depth buffer
-                glDepthFunc(depthTesting.function);
+                GLStateCache::depthFunc(depthTesting.function);
             }
             else {
-                glDisable(GL_DEPTH_TEST);
+                GLStateCache::setCapability(GL_DEPTH_TEST, false);
             }
 
             if (blending.enabled) {
-                glEnable(GL_BLEND);
+                GLStateCache::setCapability(GL_BLEND, true);
                 // glBlendEquation Specifies the blending equation that will be used to combine the source and destination colors
-                glBlendEquation(blending.equation);
+                GLStateCache::blendEquation(blending.equation);
 
                 // glBlendFunc Specifies the source and destination factors used in the blending equation
                 // e.g. GL_SRC_ALPHA and GL_ONE_MINUS_SRC_ALPHA will blend the source and destination colors using the alpha value of the source color
-                glBlendFunc(blending.sourceFactor, blending.destinationFactor);
+                GLStateCache::blendFunc(blending.sourceFactor, blending.destinationFactor);
 
                 // glBlendColor Specifies the constant color used in the blending equation
                 // e.g. if the blending equation is GL_FUNC_ADD, the final color will be (sourceColor * sourceFactor) + (destinationColor * destinationFactor) + constantColor
-                glBlendColor(blending.constantColor.r, blending.constantColor.g, blending.constantColor.b, blending.constantColor.a);
+                GLStateCache::blendColor(blending.constantColor);
             }
             else {
-                glDisable(GL_BLEND);
+                GLStateCache::setCapability(GL_BLEND, false);
             }
             // glColorMask Specifies whether the red, green, blue, and alpha components are written into the color buffer
-            glColorMask(colorMask.r, colorMask.g, colorMask.b, colorMask.a);
+            GLStateCache::colorMask(colorMask);
             
             // glDepthMask Specifies whether the depth buffer is enabled for writing
-            glDepthMask(depthMask);
+            GLStateCache::depthMask(depthMask);
         }
 
         // Given a json object, this function deserializes a PipelineState structure
         void deserialize(const nlohmann::json& data);
+
+        // Two pipeline states are equal if they would configure OpenGL in the same way
+        // The renderer uses this to skip calling "setup" if the previous draw already applied the same state
+        bool operator==(const PipelineState& other) const {
+            return faceCulling.enabled == other.faceCulling.enabled &&
+                   faceCulling.culledFace == other.faceCulling.culledFace &&
+                   faceCulling.frontFace == other.faceCulling.frontFace &&
+                   depthTesting.enabled == other.depthTesting.enabled &&
+                   depthTesting.function == other.depthTesting.function &&
+                   blending.enabled == other.blending.enabled &&
+                   blending.equation == other.blending.equation &&
+                   blending.sourceFactor == other.blending.sourceFactor &&
+                   blending.destinationFactor == other.blending.destinationFactor &&
+                   blending.constantColor == other.blending.constantColor &&
+                   colorMask == other.colorMask &&
+                   depthMask == other.depthMask;
+        }
+        bool operator!=(const PipelineState& other) const { return !(*this == other); }
     };
 
+}
+
+// We use the pipeline state as a key for a map (to give each unique state a small integer id) so we need a hash function for it
+namespace std {
+    template<> struct hash<our::PipelineState> {
+        size_t operator()(our::PipelineState const& state) const {
+            size_t combined = 0;
+            auto combine = [&combined](size_t value){ combined ^= value + 0x9e3779b9 + (combined << 6) + (combined >> 2); };
+            combine(state.faceCulling.enabled);
+            combine(state.faceCulling.culledFace);
+            combine(state.faceCulling.frontFace);
+            combine(state.depthTesting.enabled);
+            combine(state.depthTesting.function);
+            combine(state.blending.enabled);
+            combine(state.blending.equation);
+            combine(state.blending.sourceFactor);
+            combine(state.blending.destinationFactor);
+            combine(hash<glm::vec4>()(state.blending.constantColor));
+            combine(hash<glm::bvec4>()(state.colorMask));
+            combine(state.depthMask);
+            return combined;
+        }
+    };
 }
\ No newline at end of file
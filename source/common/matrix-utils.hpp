@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace our {
+
+    namespace matrix_utils {
+        // Returns the matrix that transforms the normals of an object whose local to world matrix is "matrix"
+        // This is the inverse transpose of the upper 3x3 part of the matrix. Since the matrix is affine, the translation
+        // doesn't affect the normals, so we don't need a full 4x4 inverse (nor the transpose before it).
+        // The inverse transpose of a 3x3 matrix is its cofactor matrix divided by its determinant,
+        // and the columns of the cofactor matrix are the cross products of the matrix columns
+        inline glm::mat3 normalMatrix(const glm::mat4& matrix){
+            glm::vec3 x = glm::vec3(matrix[0]), y = glm::vec3(matrix[1]), z = glm::vec3(matrix[2]);
+            glm::vec3 yz = glm::cross(y, z), zx = glm::cross(z, x), xy = glm::cross(x, y);
+            float determinant = glm::dot(x, yz);
+            return glm::mat3(yz, zx, xy) * (1.0f / determinant);
+        }
+    }
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <limits>
+
+#include "vertex.hpp"
+
+namespace our {
+
+    // An axis aligned bounding box defined by its minimum and maximum corners
+    struct AABB {
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+
+        glm::vec3 getCenter() const { return 0.5f * (min + max); }
+        glm::vec3 getExtents() const { return 0.5f * (max - min); }
+
+        // Returns the box that contains this box after being transformed by the given matrix
+        // Instead of transforming the 8 corners, we use the absolute value of the matrix to transform the extents (Arvo's method)
+        AABB transform(const glm::mat4& matrix) const {
+            glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.0f));
+            glm::mat3 absolute = glm::mat3(matrix);
+            for(int i = 0; i < 3; i++) absolute[i] = glm::abs(absolute[i]);
+            glm::vec3 extents = absolute * getExtents();
+            return {center - extents, center + extents};
+        }
+    };
+
+    // A bounding sphere defined by its center and radius
+    struct BoundingSphere {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+
+        // Returns the sphere that contains this sphere after being transformed by the given matrix
+        // Since the scale could be non-uniform, we pick the largest scale factor among the 3 axes
+        BoundingSphere transform(const glm::mat4& matrix) const {
+            glm::vec3 transformedCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+            float scale = glm::max(glm::length(glm::vec3(matrix[0])), glm::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+            return {transformedCenter, radius * scale};
+        }
+    };
+
+    namespace bounds_utils {
+        // Computes the box that tightly contains all the given vertices
+        inline AABB computeAABB(const std::vector<Vertex>& vertices){
+            if(vertices.empty()) return AABB();
+            AABB box = {glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest())};
+            for(const auto& vertex : vertices){
+                box.min = glm::min(box.min, vertex.position);
+                box.max = glm::max(box.max, vertex.position);
+            }
+            return box;
+        }
+
+        // Computes a sphere that contains all the given vertices
+        // The sphere is centered at the box center, which is not the smallest possible sphere but is good enough for culling
+        inline BoundingSphere computeBoundingSphere(const std::vector<Vertex>& vertices, const AABB& box){
+            BoundingSphere sphere = {box.getCenter(), 0.0f};
+            float radiusSquared = 0.0f;
+            for(const auto& vertex : vertices){
+                glm::vec3 offset = vertex.position - sphere.center;
+                radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+            }
+            sphere.radius = glm::sqrt(radiusSquared);
+            return sphere;
+        }
+    }
+
+}
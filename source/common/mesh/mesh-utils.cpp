@@ -7,12 +7,19 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <queue>
+#include <algorithm>
 
 our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
 
     // The data that we will use to initialize our mesh
     std::vector<our::Vertex> vertices;
     std::vector<GLuint> elements;
+    if(!loadOBJ(filename, vertices, elements)) return nullptr;
+    return new our::Mesh(vertices, elements);
+}
+
+bool our::mesh_utils::loadOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements) {
 
     // Since the OBJ can have duplicated vertices, we make them unique using this map
     // The key is the vertex, the value is its index in the vector "vertices".
@@ -27,7 +34,7 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
 
     if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
         std::cerr << "Failed to load obj file \"" << filename << "\" due to error: " << err << std::endl;
-        return nullptr;
+        return false;
     }
     if (!warn.empty()) {
         std::cout << "WARN while loading obj file \"" << filename << "\": " << warn << std::endl;
@@ -81,7 +88,233 @@ our::Mesh* our::mesh_utils::loadOBJ(const std::string& filename) {
         }
     }
 
-    return new our::Mesh(vertices, elements);
+    return true;
+}
+
+std::vector<our::Mesh*> our::mesh_utils::loadOBJLods(const std::string& filename, const std::vector<float>& ratios) {
+    std::vector<our::Vertex> vertices;
+    std::vector<GLuint> elements;
+    if(!loadOBJ(filename, vertices, elements)) return {};
+    std::vector<our::Mesh*> meshes = {new our::Mesh(vertices, elements)};
+    // Every level is simplified from the full mesh (instead of the previous level) so that the errors don't accumulate
+    for(float ratio : ratios){
+        std::vector<our::Vertex> lodVertices;
+        std::vector<GLuint> lodElements;
+        simplify(vertices, elements, ratio, lodVertices, lodElements);
+        meshes.push_back(new our::Mesh(lodVertices, lodElements));
+    }
+    return meshes;
+}
+
+namespace {
+
+    // A quadric is a symmetric 4x4 matrix Q such that p^T Q p (where p = (x, y, z, 1)) is the sum of the squared distances from p to a set of planes
+    // Adding two quadrics gives the quadric of both sets of planes. Only the upper triangle is stored
+    // Doubles are used since the sums of many planes lose a lot of precision in floats
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+
+        // The quadric of the plane dot(normal, p) + d = 0 (the normal must be normalized) multiplied by a weight
+        static Quadric fromPlane(const glm::dvec3& normal, double d, double weight){
+            Quadric q;
+            q.a00 = weight * normal.x * normal.x; q.a01 = weight * normal.x * normal.y; q.a02 = weight * normal.x * normal.z; q.a03 = weight * normal.x * d;
+            q.a11 = weight * normal.y * normal.y; q.a12 = weight * normal.y * normal.z; q.a13 = weight * normal.y * d;
+            q.a22 = weight * normal.z * normal.z; q.a23 = weight * normal.z * d;
+            q.a33 = weight * d * d;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& other){
+            a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+            a11 += other.a11; a12 += other.a12; a13 += other.a13;
+            a22 += other.a22; a23 += other.a23;
+            a33 += other.a33;
+            return *this;
+        }
+
+        double evaluate(const glm::dvec3& p) const {
+            return a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z + a33
+                 + 2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z + a03 * p.x + a13 * p.y + a23 * p.z);
+        }
+    };
+
+    // Collapsing "from" into "to" moves all the triangles of "from" to the position of "to"
+    // The versions detect the collapses that became outdated since they were added to the queue (one of their vertices changed)
+    struct Collapse {
+        double cost;
+        GLuint from, to;
+        uint32_t fromVersion, toVersion;
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    struct SimplifierTriangle {
+        GLuint corners[3];  // The indices of the original vertices (their attributes are kept)
+        GLuint ids[3];      // The indices of the welded positions (they change as the edges are collapsed)
+        bool removed;
+
+        bool contains(GLuint id) const { return ids[0] == id || ids[1] == id || ids[2] == id; }
+    };
+
+    // The boundary edges are kept in place by a plane perpendicular to their triangle, weighted more than the surface planes
+    // Otherwise, the holes of open meshes would grow since moving a boundary vertex along the surface costs nothing
+    constexpr double BOUNDARY_WEIGHT = 10.0;
+
+}
+
+void our::mesh_utils::simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements, float ratio,
+                               std::vector<Vertex>& simplifiedVertices, std::vector<GLuint>& simplifiedElements) {
+    simplifiedVertices.clear();
+    simplifiedElements.clear();
+    if(ratio >= 1.0f || elements.size() < 3){
+        simplifiedVertices = vertices;
+        simplifiedElements = elements;
+        return;
+    }
+
+    // Weld the vertices by position. The vertices that share a position (but differ in their normals or texture coordinates) move together
+    std::unordered_map<glm::vec3, GLuint> positionIds;
+    std::vector<glm::dvec3> positions;
+    std::vector<GLuint> vertexPositions(vertices.size());
+    for(size_t i = 0; i < vertices.size(); i++){
+        auto [it, added] = positionIds.try_emplace(vertices[i].position, (GLuint)positions.size());
+        if(added) positions.push_back(glm::dvec3(vertices[i].position));
+        vertexPositions[i] = it->second;
+    }
+
+    std::vector<SimplifierTriangle> triangles;
+    for(size_t i = 0; i + 2 < elements.size(); i += 3){
+        SimplifierTriangle triangle = {{elements[i], elements[i + 1], elements[i + 2]}, {}, false};
+        for(int k = 0; k < 3; k++) triangle.ids[k] = vertexPositions[triangle.corners[k]];
+        if(triangle.ids[0] == triangle.ids[1] || triangle.ids[1] == triangle.ids[2] || triangle.ids[0] == triangle.ids[2]) continue;
+        triangles.push_back(triangle);
+    }
+
+    // Every position starts with the planes of its triangles (weighted by their areas) and the triangles are linked to their positions
+    std::vector<Quadric> quadrics(positions.size());
+    std::vector<std::vector<GLuint>> positionTriangles(positions.size());
+    std::unordered_map<uint64_t, int> edgeUses;
+    auto edgeKey = [](GLuint a, GLuint b){ return ((uint64_t)std::min(a, b) << 32) | std::max(a, b); };
+    for(GLuint t = 0; t < (GLuint)triangles.size(); t++){
+        const SimplifierTriangle& triangle = triangles[t];
+        glm::dvec3 p0 = positions[triangle.ids[0]], p1 = positions[triangle.ids[1]], p2 = positions[triangle.ids[2]];
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(normal);
+        if(length > 0){
+            normal /= length;
+            Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+            for(int k = 0; k < 3; k++) quadrics[triangle.ids[k]] += plane;
+        }
+        for(int k = 0; k < 3; k++){
+            positionTriangles[triangle.ids[k]].push_back(t);
+            edgeUses[edgeKey(triangle.ids[k], triangle.ids[(k + 1) % 3])]++;
+        }
+    }
+    for(const SimplifierTriangle& triangle : triangles){
+        glm::dvec3 p0 = positions[triangle.ids[0]], p1 = positions[triangle.ids[1]], p2 = positions[triangle.ids[2]];
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        for(int k = 0; k < 3; k++){
+            GLuint a = triangle.ids[k], b = triangle.ids[(k + 1) % 3];
+            if(edgeUses[edgeKey(a, b)] != 1) continue;
+            glm::dvec3 edge = positions[b] - positions[a];
+            glm::dvec3 boundaryNormal = glm::cross(edge, normal);
+            double length = glm::length(boundaryNormal);
+            if(length == 0) continue;
+            boundaryNormal /= length;
+            Quadric plane = Quadric::fromPlane(boundaryNormal, -glm::dot(boundaryNormal, positions[a]), BOUNDARY_WEIGHT * glm::dot(edge, edge));
+            quadrics[a] += plane;
+            quadrics[b] += plane;
+        }
+    }
+
+    // The collapses are ordered by their cost. Each edge is collapsed in the direction that adds less error
+    std::vector<uint32_t> versions(positions.size(), 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto addEdge = [&](GLuint a, GLuint b){
+        Quadric q = quadrics[a];
+        q += quadrics[b];
+        double intoB = q.evaluate(positions[b]), intoA = q.evaluate(positions[a]);
+        if(intoB <= intoA) queue.push({intoB, a, b, versions[a], versions[b]});
+        else queue.push({intoA, b, a, versions[b], versions[a]});
+    };
+    for(const SimplifierTriangle& triangle : triangles){
+        for(int k = 0; k < 3; k++) addEdge(triangle.ids[k], triangle.ids[(k + 1) % 3]);
+    }
+
+    size_t liveTriangles = triangles.size();
+    size_t targetTriangles = std::max<size_t>(1, (size_t)(ratio * triangles.size()));
+    while(liveTriangles > targetTriangles && !queue.empty()){
+        Collapse collapse = queue.top();
+        queue.pop();
+        if(versions[collapse.from] != collapse.fromVersion || versions[collapse.to] != collapse.toVersion) continue;
+
+        // Reject the collapse if it flips any of the triangles that survive it or if no triangle would survive it
+        bool valid = true;
+        size_t removedTriangles = 0;
+        for(GLuint t : positionTriangles[collapse.from]){
+            const SimplifierTriangle& triangle = triangles[t];
+            if(triangle.removed) continue;
+            if(triangle.contains(collapse.to)){
+                removedTriangles++;
+                continue;
+            }
+            glm::dvec3 before[3], after[3];
+            for(int k = 0; k < 3; k++){
+                before[k] = positions[triangle.ids[k]];
+                after[k] = triangle.ids[k] == collapse.from ? positions[collapse.to] : before[k];
+            }
+            glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if(glm::dot(normalBefore, normalAfter) <= 0){
+                valid = false;
+                break;
+            }
+        }
+        if(!valid || removedTriangles >= liveTriangles) continue;
+
+        // The triangles sharing the edge disappear and the rest of the triangles of "from" move to "to"
+        for(GLuint t : positionTriangles[collapse.from]){
+            SimplifierTriangle& triangle = triangles[t];
+            if(triangle.removed) continue;
+            if(triangle.contains(collapse.to)){
+                triangle.removed = true;
+                liveTriangles--;
+                continue;
+            }
+            for(int k = 0; k < 3; k++) if(triangle.ids[k] == collapse.from) triangle.ids[k] = collapse.to;
+            positionTriangles[collapse.to].push_back(t);
+        }
+        positionTriangles[collapse.from].clear();
+        quadrics[collapse.to] += quadrics[collapse.from];
+        versions[collapse.from]++;
+        versions[collapse.to]++;
+
+        // The costs of all the edges around "to" changed, so they are added again (and the removed triangles are dropped from its list)
+        std::vector<GLuint>& around = positionTriangles[collapse.to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](GLuint t){ return triangles[t].removed; }), around.end());
+        for(GLuint t : around){
+            for(int k = 0; k < 3; k++){
+                if(triangles[t].ids[k] != collapse.to) addEdge(collapse.to, triangles[t].ids[k]);
+            }
+        }
+    }
+
+    // Each corner keeps the attributes of its original vertex at the position that it was collapsed into
+    std::unordered_map<our::Vertex, GLuint> vertexMap;
+    for(const SimplifierTriangle& triangle : triangles){
+        if(triangle.removed) continue;
+        for(int k = 0; k < 3; k++){
+            our::Vertex vertex = vertices[triangle.corners[k]];
+            vertex.position = glm::vec3(positions[triangle.ids[k]]);
+            auto [it, added] = vertexMap.try_emplace(vertex, (GLuint)simplifiedVertices.size());
+            if(added) simplifiedVertices.push_back(vertex);
+            simplifiedElements.push_back(it->second);
+        }
+    }
+    // If every triangle was degenerate, the original data is kept so that the mesh is never empty
+    if(simplifiedElements.empty()){
+        simplifiedVertices = vertices;
+        simplifiedElements = elements;
+    }
 }
 
 // Create a sphere (the vertex order in the triangles are CCW from the outside)
@@ -120,4 +353,24 @@ our::Mesh* our::mesh_utils::sphere(const glm::ivec2& segments){
     }
 
     return new our::Mesh(vertices, elements);
-}
\ No newline at end of file
+}
+
+// Create a cube from (-1, -1, -1) to (1, 1, 1) (the vertex order in the triangles are CCW from the outside)
+our::Mesh* our::mesh_utils::cube(){
+    std::vector<our::Vertex> vertices;
+    // The bits of the corner index pick its x (bit 0), y (bit 1) & z (bit 2)
+    for(int corner = 0; corner < 8; corner++){
+        glm::vec3 position = {(corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f};
+        glm::vec2 tex_coords = glm::vec2((corner & 1) ? 1.0f : 0.0f, (corner & 2) ? 1.0f : 0.0f);
+        vertices.push_back({position, our::Color(255, 255, 255, 255), tex_coords, glm::normalize(position)});
+    }
+    std::vector<GLuint> elements = {
+        0, 2, 3, 0, 3, 1, // -Z
+        4, 5, 7, 4, 7, 6, // +Z
+        0, 4, 6, 0, 6, 2, // -X
+        1, 3, 7, 1, 7, 5, // +X
+        0, 1, 5, 0, 5, 4, // -Y
+        2, 6, 7, 2, 7, 3  // +Y
+    };
+    return new our::Mesh(vertices, elements);
+}
@@ -2,11 +2,26 @@
 
 #include "mesh.hpp"
 #include <string>
+#include <vector>
 
 namespace our::mesh_utils {
     // Load an ".obj" file into the mesh
     Mesh* loadOBJ(const std::string& filename);
+    // Load an ".obj" file into the given vertices & elements (without creating a mesh). Returns false if the file couldn't be loaded
+    bool loadOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<GLuint>& elements);
+    // Load an ".obj" file into a chain of meshes for level of detail: the first mesh is the full mesh
+    // followed by one simplified mesh for every ratio (the fraction of the triangles that it keeps, see "simplify")
+    // Returns an empty vector if the file couldn't be loaded
+    std::vector<Mesh*> loadOBJLods(const std::string& filename, const std::vector<float>& ratios);
+    // Simplifies the given mesh data until at most "ratio" of its triangles are left (or no more edges can be collapsed)
+    // It repeatedly collapses the edge whose collapse adds the least error, measured using quadric error metrics (Garland & Heckbert)
+    // The vertices are welded by position first, so the seams of the texture coordinates & normals never open into cracks
+    void simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& elements, float ratio,
+                  std::vector<Vertex>& simplifiedVertices, std::vector<GLuint>& simplifiedElements);
     // Create a sphere (the vertex order in the triangles are CCW from the outside)
     // Segments define the number of divisions on the both the latitude and the longitude
     Mesh* sphere(const glm::ivec2& segments);
+    // Create a cube from (-1, -1, -1) to (1, 1, 1) (the vertex order in the triangles are CCW from the outside)
+    // The 8 corners are shared between the faces, so it is only meant for drawing bounds (e.g. occlusion query proxies), not for lighting
+    Mesh* cube();
 }
\ No newline at end of file
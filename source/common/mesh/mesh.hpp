@@ -1,7 +1,9 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state-cache.hpp"
 #include "vertex.hpp"
+#include "bounds.hpp"
 
 namespace our {
 
@@ -9,6 +11,9 @@ namespace our {
     #define ATTRIB_LOC_COLOR    1
     #define ATTRIB_LOC_TEXCOORD 2
     #define ATTRIB_LOC_NORMAL   3
+    // The per-instance attributes used by the instanced shaders (a mat4 takes 4 locations & a mat3 takes 3 locations)
+    #define ATTRIB_LOC_INSTANCE_TRANSFORM 4
+    #define ATTRIB_LOC_INSTANCE_NORMAL    8
 
     class Mesh {
         // Here, we store the object names of the 3 main components of a mesh:
@@ -17,6 +22,16 @@ namespace our {
         unsigned int VAO;
         // We need to remember the number of elements that will be draw by glDrawElements 
         GLsizei elementCount;
+        // The number of vertices in the vertex buffer (needed to read them back)
+        size_t vertexCount;
+        // The bounds of the mesh in its local space. They are computed once from the vertices when the mesh is created
+        // and they are used by the renderer to skip the objects that are outside the camera frustum
+        AABB aabb;
+        BoundingSphere boundingSphere;
+        // A copy of the vertex positions & the elements kept on the RAM so that the mesh can be rasterized on the CPU as an occluder (see "OcclusionCuller")
+        // Only the meshes used as occluders need it, so it is empty until "keepOccluderData" is called
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> elements;
     public:
 
         // The constructor takes two vectors:
@@ -35,7 +50,7 @@ namespace our {
             //create vertex array object and bind it 
             glGenVertexArrays(1, &VAO);
             //1 is the number of vertex array objects to be generated
-            glBindVertexArray(VAO);
+            GLStateCache::bindVertexArray(VAO);
             
             // create vertex buffer object and bind it
             glGenBuffers(1, &VBO);
@@ -79,7 +94,7 @@ namespace our {
             glEnableVertexAttribArray(ATTRIB_LOC_NORMAL);
 
             // unbind the VAO
-            glBindVertexArray(0);
+            GLStateCache::bindVertexArray(0);
 
             // unbind the VBO
             glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -88,18 +103,62 @@ namespace our {
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
             elementCount = (GLsizei)elements.size();
+            vertexCount = vertices.size();
 
+            // Since the vertices won't be kept on the RAM, we compute the local bounds now
+            aabb = bounds_utils::computeAABB(vertices);
+            boundingSphere = bounds_utils::computeBoundingSphere(vertices, aabb);
+        }
+
+        // Get the internal OpenGL name of the vertex array object of this mesh
+        GLuint getVertexArray() const { return VAO; }
+
+        // Returns the box containing the mesh in its local space
+        const AABB& getAABB() const { return aabb; }
+        // Returns the sphere containing the mesh in its local space
+        const BoundingSphere& getBoundingSphere() const { return boundingSphere; }
+        // Returns the number of triangles drawn by "draw"
+        GLsizei getTriangleCount() const { return elementCount / 3; }
+        // Returns the vertex positions & the elements kept on the RAM for the occlusion culling (empty unless "keepOccluderData" was called)
+        const std::vector<glm::vec3>& getPositions() const { return positions; }
+        const std::vector<unsigned int>& getElements() const { return elements; }
+
+        // Reads all the vertex attributes back from the vertex buffer
+        // This waits for the GPU, so it should only be used while loading (e.g. to merge the static meshes into batches)
+        std::vector<Vertex> readVertices() const {
+            std::vector<Vertex> vertices(vertexCount);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), vertices.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return vertices;
+        }
+
+        // Reads the elements back from the element buffer (it waits for the GPU too)
+        // The element buffer binding is part of the vertex array state, so it is bound to GL_COPY_READ_BUFFER instead to leave the bound VAO unchanged
+        std::vector<unsigned int> readElements() const {
+            std::vector<unsigned int> result(elementCount);
+            glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, result.size() * sizeof(unsigned int), result.data());
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            return result;
+        }
+
+        // Reads the vertex positions & the elements back to the RAM so that the mesh can be used as an occluder
+        // It is called while loading for the meshes that are marked as occluders, calling it again does nothing
+        void keepOccluderData(){
+            if(!positions.empty()) return;
+            std::vector<Vertex> vertices = readVertices();
+            positions.reserve(vertices.size());
+            for(const auto& vertex : vertices) positions.push_back(vertex.position);
+            elements = readElements();
         }
 
         // this function should render the mesh
         void draw() 
         {
             //TODO: (Req 2) Write this function
-            // bind the VAO
-            glBindVertexArray(VAO);
-
-            // bind the EBO
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            // bind the VAO (the EBO binding is stored in the VAO, so we don't need to bind it again)
+            GLStateCache::bindVertexArray(VAO);
 
             // draw the triangles
             glDrawElements(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0);
@@ -108,11 +167,19 @@ namespace our {
             // GL_UNSIGNED_INT is the data type of the indices in the element array buffer.
             // 0 is the offset in the element array buffer.
 
-            // unbind the VAO
-            glBindVertexArray(0);
+            // We don't unbind the VAO here, so that drawing the same mesh again doesn't need to rebind it
+            // Any code that modifies a VAO should bind it first (through the GLStateCache)
 
         }
 
+        // Draws the given number of instances of the mesh by a single draw call
+        // The per-instance attributes should be already attached to the vertex array of this mesh (see "InstanceBuffer")
+        void drawInstanced(GLsizei instanceCount)
+        {
+            GLStateCache::bindVertexArray(VAO);
+            glDrawElementsInstanced(GL_TRIANGLES, elementCount, GL_UNSIGNED_INT, 0, instanceCount);
+        }
+
         // this function should delete the vertex & element buffers and the vertex array object
         ~Mesh(){
             //TODO: (Req 2) Write this function
@@ -122,6 +189,7 @@ namespace our {
             //1 is the number of buffer objects to be deleted.
             //&VBO is a pointer to the buffer objects to be deleted.
             glDeleteBuffers(1, &EBO);
+            GLStateCache::forgetVertexArray(VAO);
             glDeleteVertexArrays(1, &VAO);
 
         }
@@ -50,7 +50,7 @@ bool our::ShaderProgram::attach(const std::string &filename, GLenum type) const
 
 
 
-bool our::ShaderProgram::link() const {
+bool our::ShaderProgram::link() {
     //TODO: Complete this function
     //Note: The function "checkForLinkingErrors" checks if there is
     // an error in the given program. You should use it to check if there is a
@@ -66,6 +66,46 @@ bool our::ShaderProgram::link() const {
         std::cerr << error << std::endl;
         return false;
     }
+
+    // Connect the engine uniform blocks used by this program to their binding points (this is done once per program)
+    for(const auto& block : uniform_blocks::ALL){
+        GLuint index = glGetUniformBlockIndex(program, block.name);
+        if(index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, block.binding);
+    }
+
+    // Now we read the location of every active uniform once, so that we never need to query the driver while drawing
+    locations.clear();
+    GLint uniformCount = 0, maxNameLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<char> nameBuffer(maxNameLength + 1);
+    for(GLint index = 0; index < uniformCount; index++){
+        GLint size; GLenum type;
+        glGetActiveUniform(program, index, (GLsizei)nameBuffer.size(), nullptr, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data());
+        GLint location = glGetUniformLocation(program, name.c_str());
+        // Uniforms inside uniform blocks have no location so we skip them
+        if(location < 0) continue;
+        storeLocation(name, location);
+        // Arrays are reported once with the name of their first element (e.g. "values[0]")
+        // so we also store the name without the index and the names of the remaining elements
+        if(size > 1 || (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)){
+            std::string base = name.substr(0, name.size() - 3);
+            storeLocation(base, location);
+            for(GLint element = 1; element < size; element++){
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                storeLocation(elementName, glGetUniformLocation(program, elementName.c_str()));
+            }
+        }
+    }
+
+    // The engine samplers always read from the same texture units, so we set them here instead of before every draw
+    for(const auto& sampler : texture_units::ALL){
+        GLint location = glGetUniformLocation(program, sampler.name);
+        if(location < 0) continue;
+        GLStateCache::useProgram(program);
+        glUniform1i(location, (GLint)sampler.unit);
+    }
     return true;
 }
 
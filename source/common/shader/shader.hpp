@@ -2,20 +2,93 @@
 #define SHADER_HPP
 
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 
 #include <glad/gl.h>
+#include "../gl-state-cache.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 namespace our {
 
+    // The binding points of the uniform blocks used by the engine.
+    // After linking, every block in this list that is found in the program is connected to its binding point,
+    // so the buffers only need to be bound to these points and never per program
+    namespace uniform_blocks {
+        constexpr GLuint LIGHTS = 0;
+
+        struct BlockBinding { const char* name; GLuint binding; };
+        constexpr BlockBinding ALL[] = {
+            {"Lights", LIGHTS}
+        };
+    }
+
+    // The texture units reserved for the engine samplers. The materials use the units from 0 upwards, so we use the last ones we need.
+    // The sampler uniforms of each program are set to these units once when it is linked
+    namespace texture_units {
+        constexpr GLuint CLUSTER_TABLE = 5;
+        constexpr GLuint CLUSTER_INDICES = 6;
+        constexpr GLuint CLUSTER_LIGHTS = 7;
+
+        struct SamplerBinding { const char* name; GLuint unit; };
+        constexpr SamplerBinding ALL[] = {
+            {"cluster_table", CLUSTER_TABLE},
+            {"cluster_indices", CLUSTER_INDICES},
+            {"cluster_lights", CLUSTER_LIGHTS}
+        };
+    }
+
+    // A handle to a uniform name. Each distinct uniform name is interned once (see "ShaderProgram::intern")
+    // and gets a small index which is the same for all the shader programs.
+    // Setting a uniform using a UniformId is just an array access (no string hashing and no driver query).
+    struct UniformId {
+        uint32_t index;
+    };
+
     class ShaderProgram {
 
     private:
         //Shader Program Handle (OpenGL object name)
         GLuint program;
+        // The location of each uniform in this program where the index is the UniformId of the uniform name
+        // It is filled once after linking, names that are not used by the program have the location -1
+        std::vector<GLint> locations;
+
+        // The interned uniform names. They are shared by all the programs so that a UniformId is valid for any program
+        static std::unordered_map<std::string, uint32_t>& getInternedNames(){
+            static std::unordered_map<std::string, uint32_t> names;
+            return names;
+        }
+        static std::vector<std::string>& getInternedNamesById(){
+            static std::vector<std::string> names;
+            return names;
+        }
+
+        // Stores the location of the given uniform name in the locations table
+        void storeLocation(const std::string& name, GLint location){
+            UniformId id = intern(name);
+            if(id.index >= locations.size()) locations.resize(id.index + 1, -1);
+            locations[id.index] = location;
+        }
 
     public:
+        // If false, every uniform location is queried from the driver using glGetUniformLocation (as if there is no cache)
+        // This is only useful to benchmark the cost of the uniform uploads with and without the cache
+        static inline bool useLocationCache = true;
+        // The number of glGetUniformLocation calls made since the start of the program
+        static inline uint64_t locationQueries = 0;
+
+        // Returns the id of the given uniform name. If the name was never seen before, a new id is created for it.
+        // This should be called once (e.g. when initializing) and the id should be stored and used afterwards
+        static UniformId intern(const std::string& name){
+            auto& names = getInternedNames();
+            auto [it, inserted] = names.try_emplace(name, (uint32_t)names.size());
+            if(inserted) getInternedNamesById().push_back(name);
+            return {it->second};
+        }
+
         ShaderProgram(){
             //TODO: (Req 1) Create A shader program
             program = glCreateProgram();
@@ -23,56 +96,100 @@ namespace our {
         ~ShaderProgram(){
             //TODO: (Req 1) Delete a shader program
             if (program != 0) {
+                GLStateCache::forgetProgram(program);
                 glDeleteProgram(program);
             }
         }
 
         bool attach(const std::string &filename, GLenum type) const;
 
-        bool link() const;
+        // Links the program, then reads the locations of all its active uniforms into the locations table
+        bool link();
 
         void use() { 
-            glUseProgram(program);
+            GLStateCache::useProgram(program);
         }
 
-        GLuint getUniformLocation(const std::string &name) {
+        // Get the internal OpenGL name of the program (it is also used by the renderer to group the draws sharing the same program)
+        GLuint getOpenGLName() const {
+            return program;
+        }
+
+        GLint getUniformLocation(const std::string &name) {
             //TODO: (Req 1) Return the location of the uniform with the given name
-            return glGetUniformLocation(program, name.c_str());
+            if(!useLocationCache){
+                locationQueries++;
+                return glGetUniformLocation(program, name.c_str());
+            }
+            // Since all the active uniforms were interned after linking, a name that was never interned is not in the program
+            auto& names = getInternedNames();
+            auto it = names.find(name);
+            if(it == names.end()) return -1;
+            return getUniformLocation(UniformId{it->second});
+        }
+
+        GLint getUniformLocation(UniformId id) {
+            if(!useLocationCache){
+                locationQueries++;
+                return glGetUniformLocation(program, getInternedNamesById()[id.index].c_str());
+            }
+            return id.index < locations.size() ? locations[id.index] : -1;
         }
 
+        // These functions send the given value to the uniform with the given location
+        void set(GLint location, GLfloat value) { glUniform1f(location, value); }
+        void set(GLint location, GLuint value) { glUniform1ui(location, value); }
+        void set(GLint location, GLint value) { glUniform1i(location, value); }
+        void set(GLint location, glm::vec2 value) { glUniform2f(location, value.x, value.y); }
+        void set(GLint location, glm::vec3 value) { glUniform3f(location, value.x, value.y, value.z); }
+        void set(GLint location, glm::vec4 value) { glUniform4f(location, value.x, value.y, value.z, value.w); }
+        void set(GLint location, const glm::mat3& matrix) { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(matrix)); }
+        void set(GLint location, const glm::mat4& matrix) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix)); }
+        // Sends the first "count" elements of an integer array uniform
+        void set(GLint location, const GLint* values, GLsizei count) { glUniform1iv(location, count, values); }
+
+        // These functions send the given value to the uniform with the given id (this is what should be used in hot paths)
+        template<typename T>
+        void set(UniformId id, const T& value) { set(getUniformLocation(id), value); }
+        void set(UniformId id, const GLint* values, GLsizei count) { set(getUniformLocation(id), values, count); }
+
         void set(const std::string &uniform, GLfloat value) {
             //TODO: (Req 1) Send the given float value to the given uniform
-            glUniform1f(getUniformLocation(uniform), value);
+            set(getUniformLocation(uniform), value);
         }
 
         void set(const std::string &uniform, GLuint value) {
             //TODO: (Req 1) Send the given unsigned integer value to the given uniform
-            glUniform1ui(getUniformLocation(uniform), value);
+            set(getUniformLocation(uniform), value);
         }
 
         void set(const std::string &uniform, GLint value) {
             //TODO: (Req 1) Send the given integer value to the given uniform
-            glUniform1i(getUniformLocation(uniform), value);
+            set(getUniformLocation(uniform), value);
         }
 
         void set(const std::string &uniform, glm::vec2 value) {
             //TODO: (Req 1) Send the given 2D vector value to the given uniform
-            glUniform2f(getUniformLocation(uniform), value.x, value.y);
+            set(getUniformLocation(uniform), value);
         }
 
         void set(const std::string &uniform, glm::vec3 value) {
             //TODO: (Req 1) Send the given 3D vector value to the given uniform
-            glUniform3f(getUniformLocation(uniform), value.x, value.y, value.z);
+            set(getUniformLocation(uniform), value);
         }
 
         void set(const std::string &uniform, glm::vec4 value) {
             //TODO: (Req 1) Send the given 4D vector value to the given uniform
-            glUniform4f(getUniformLocation(uniform), value.x, value.y, value.z, value.w);
+            set(getUniformLocation(uniform), value);
+        }
+
+        void set(const std::string &uniform, const glm::mat3& matrix) {
+            set(getUniformLocation(uniform), matrix);
         }
 
         void set(const std::string &uniform, glm::mat4 matrix) {
             //TODO: (Req 1) Send the given matrix 4x4 value to the given uniform
-            glUniformMatrix4fv(getUniformLocation(uniform), 1, GL_FALSE, glm::value_ptr(matrix));
+            set(getUniformLocation(uniform), matrix);
         }
 
         //TODO: (Req 1) Delete the copy constructor and assignment operator.
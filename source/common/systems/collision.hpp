@@ -34,14 +34,11 @@ namespace our
 
             Entity *playerMesh = nullptr;
 
-            for (auto entity : world->getEntities())
-            {
-                if (entity->name == "monkey")
-                {
+            // The player has a collision component, so we only search the entities that have one
+            world->view<CollisionComponent>().each([&](Entity* entity, CollisionComponent&){
+                if (!playerMesh && entity->name == "monkey")
                     playerMesh = entity;
-                    break;
-                }
-            }
+            });
 
             if (!playerMesh)
                 return;
@@ -55,16 +52,14 @@ namespace our
             playerPosition = collision->center + glm::vec3(playerMesh->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1));
             playerRadius = collision->radius * glm::length(playerMesh->localTransform.scale);
 
-            for (auto entity : world->getEntities())
+            // get all entities that have collision component
+            world->view<CollisionComponent>().each([&](Entity* entity, CollisionComponent& collision)
             {
-
-                // get all entities that have collision component
-                CollisionComponent *collision = entity->getComponent<CollisionComponent>();
-                if (collision && entity->name != "monkey")
+                if (entity->name != "monkey")
                 {
                     // get the new radius and position of the entity
-                    glm::vec3 newPosition = collision->center + glm::vec3(entity->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1));
-                    float newRadius = collision->radius * glm::length(entity->localTransform.scale);
+                    glm::vec3 newPosition = collision.center + glm::vec3(entity->getLocalToWorldMatrix() * glm::vec4(0, 0, 0, 1));
+                    float newRadius = collision.radius * glm::length(entity->localTransform.scale);
                     // compare with player position to check if it collides or not
                     if (glm::length(newPosition - playerPosition) < playerRadius + newRadius)
                     {
@@ -73,14 +68,15 @@ namespace our
                         {
                             app->changeState("menu");
                         }
+                        // the coin is only marked here since deleting it would move the rows that the view is visiting
                         if (entity->name == "coin")
                         {
                             world->markForRemoval(entity);
-                            world->deleteMarkedEntities();
                         }
                     }
                 }
-            }
+            });
+            world->deleteMarkedEntities();
         }
     };
 
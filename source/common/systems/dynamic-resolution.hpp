@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <json/json.hpp>
+#include <cmath>
+
+namespace our {
+
+    // Picks the resolution at which the scene is drawn so that the frame time stays within a budget
+    // Every frame, the renderer reports the CPU time it took to draw and this class measures the GPU time using a timer query.
+    // The frame is bound by the slower of the two, so if it exceeds the budget, the resolution scale is lowered (and raised when there is headroom).
+    // Since the GPU time is roughly proportional to the number of pixels (scale^2), the scale that would hit the budget is scale * sqrt(budget / time)
+    class DynamicResolution {
+        // Reading a query right after the frame would stall the CPU, so we use a ring of queries and read the oldest one
+        static constexpr int QUERY_COUNT = 3;
+        GLuint queries[QUERY_COUNT] = {};
+        bool queryPending[QUERY_COUNT] = {};
+        int queryIndex = 0;
+
+        float budget = 16.67f;          // The target frame time in milliseconds
+        float minScale = 0.5f, maxScale = 1.0f;
+        float scale = 1.0f;
+        double gpuTime = 0;             // The GPU time of the last frame whose query was read (in milliseconds)
+        double smoothedFrameTime = 0;   // The frame time averaged over the last few frames (so that a single spike doesn't change the scale)
+
+    public:
+        // Reads the budget & the scale limits from the renderer configuration and creates the queries
+        void create(const nlohmann::json& config){
+            budget = config.value("frameBudget", 16.67f);
+            minScale = glm::clamp(config.value("minResolutionScale", 0.5f), 0.1f, 1.0f);
+            maxScale = glm::clamp(config.value("maxResolutionScale", 1.0f), minScale, 1.0f);
+            scale = maxScale;
+            glGenQueries(QUERY_COUNT, queries);
+        }
+
+        void destroy(){
+            if(queries[0]) glDeleteQueries(QUERY_COUNT, queries);
+            for(int i = 0; i < QUERY_COUNT; i++){
+                queries[i] = 0;
+                queryPending[i] = false;
+            }
+        }
+
+        // Returns the size at which the scene should be drawn this frame
+        glm::ivec2 getRenderSize(glm::ivec2 windowSize) const {
+            return glm::max(glm::ivec2(glm::round(glm::vec2(windowSize) * scale)), glm::ivec2(1));
+        }
+
+        // These should surround the GPU work of the frame (the budget is compared against all of it, not only the part that scales)
+        void beginGpuTimer(){
+            glBeginQuery(GL_TIME_ELAPSED, queries[queryIndex]);
+        }
+        void endGpuTimer(){
+            glEndQuery(GL_TIME_ELAPSED);
+            queryPending[queryIndex] = true;
+            queryIndex = (queryIndex + 1) % QUERY_COUNT;
+        }
+
+        // Adjusts the scale for the next frame given the CPU time (in milliseconds) that the renderer took to draw this frame
+        void update(double cpuTime){
+            // "queryIndex" now points to the oldest query in the ring
+            if(queryPending[queryIndex]){
+                GLuint available = 0;
+                glGetQueryObjectuiv(queries[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(available){
+                    GLuint64 nanoseconds = 0;
+                    glGetQueryObjectui64v(queries[queryIndex], GL_QUERY_RESULT, &nanoseconds);
+                    gpuTime = nanoseconds * 1e-6;
+                    queryPending[queryIndex] = false;
+                }
+            }
+            double frameTime = glm::max(cpuTime, gpuTime);
+            smoothedFrameTime = smoothedFrameTime <= 0 ? frameTime : smoothedFrameTime + (frameTime - smoothedFrameTime) * 0.1;
+            if(smoothedFrameTime <= 0) return;
+            float target = glm::clamp(scale * (float)std::sqrt(budget / smoothedFrameTime), minScale, maxScale);
+            // Small differences are ignored and big ones are approached gradually so that the resolution doesn't oscillate
+            if(std::abs(target - scale) > 0.02f) scale += (target - scale) * 0.25f;
+            scale = glm::clamp(scale, minScale, maxScale);
+        }
+
+        float getScale() const { return scale; }
+        float getBudget() const { return budget; }
+        double getGpuTime() const { return gpuTime; }
+        double getFrameTime() const { return smoothedFrameTime; }
+    };
+
+}
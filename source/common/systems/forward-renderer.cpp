@@ -1,13 +1,80 @@
 #include "forward-renderer.hpp"
 #include "../mesh/mesh-utils.hpp"
 #include "../texture/texture-utils.hpp"
+#include "../matrix-utils.hpp"
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <chrono>
+#include <imgui.h>
 
 namespace our {
 
     void ForwardRenderer::initialize(glm::ivec2 windowSize, const nlohmann::json& config){
         // First, we store the window size for later use
         this->windowSize = windowSize;
+        // Frustum culling is enabled by default but it can be disabled from the configuration (useful for debugging)
+        this->frustumCulling = config.value("frustumCulling", true);
+        // Occlusion culling is disabled by default since it only pays off in scenes where big occluders hide many objects
+        // The occluders are rasterized into a buffer of "occlusionBufferSize" pixels (a low resolution is enough and cheaper to fill)
+        this->occlusionCulling = config.value("occlusionCulling", false);
+        if(occlusionCulling) occlusionCuller.create(config.value("occlusionBufferSize", glm::ivec2(256, 128)));
+        // The lights uniform buffer is needed by any lit material
+        lightBuffer.create();
+        // Clustered lighting is disabled by default, the number of clusters along x, y & z can be changed using "clusterCounts"
+        this->clusteredLighting = config.value("clusteredLighting", false);
+        if(clusteredLighting) lightClusters.create(config.value("clusterCounts", glm::ivec3(16, 9, 24)));
+        // Per-object light culling is disabled by default, it has no effect if clustered lighting is enabled
+        this->objectLightCulling = config.value("objectLightCulling", false) && !clusteredLighting;
+        // The levels of detail are used by default but they can be disabled from the configuration (useful for comparing the quality)
+        this->levelOfDetail = config.value("levelOfDetail", true);
+        // Instancing is enabled by default but it can be disabled from the configuration (useful for comparing the performance)
+        this->instancing = config.value("instancing", true);
+        this->minInstances = config.value("minInstances", 2);
+        instanceBuffer.create();
+        // The command extraction is split across all the hardware threads by default. It can be disabled by setting "extractionThreads" to 1
+        // or limited to a certain number of threads (0 means that all the hardware threads are used)
+        int extractionThreads = config.value("extractionThreads", 0);
+        if(extractionThreads != 1) workerPool = std::make_unique<WorkerPool>((size_t)std::max(0, extractionThreads));
+        this->minEntitiesPerWorker = config.value("minEntitiesPerWorker", 512);
+
+        // The depth pre-pass is disabled by default since it only pays off when the scene has a lot of overdraw with expensive materials
+        this->depthPrepass = config.value("depthPrepass", false);
+        // Occlusion queries are disabled by default. By default, only the meshes with at least "minQueryTriangles" triangles are queried
+        // since drawing a box and a query costs more than drawing a simple mesh (a mesh renderer can override this using "occlusionQuery")
+        this->occlusionQueries = config.value("occlusionQueries", false);
+        this->minQueryTriangles = config.value("minQueryTriangles", 2000);
+        if(depthPrepass || occlusionQueries){
+            depthShader = new ShaderProgram();
+            depthShader->attach("assets/shaders/depth-only.vert", GL_VERTEX_SHADER);
+            depthShader->attach("assets/shaders/depth-only.frag", GL_FRAGMENT_SHADER);
+            depthShader->link();
+        }
+        if(occlusionQueries){
+            proxyBox = mesh_utils::cube();
+            // The proxies are tested against the depth of the scene without changing anything. The faces are not culled
+            // so that the box is still tested if the camera is inside it
+            proxyPipelineState.depthTesting.enabled = true;
+            proxyPipelineState.depthTesting.function = GL_LEQUAL;
+            proxyPipelineState.colorMask = glm::bvec4(false);
+            proxyPipelineState.depthMask = false;
+        }
+        if(depthPrepass){
+            depthInstancedShader = new ShaderProgram();
+            depthInstancedShader->attach("assets/shaders/depth-only-instanced.vert", GL_VERTEX_SHADER);
+            depthInstancedShader->attach("assets/shaders/depth-only.frag", GL_FRAGMENT_SHADER);
+            depthInstancedShader->link();
+        }
+        // The shaded samples are counted if requested (useful to compare the overdraw with & without the depth pre-pass)
+        this->fragmentStats = config.value("fragmentStats", false);
+        if(fragmentStats) glGenQueries(SAMPLE_QUERY_COUNT, sampleQueries);
+        this->showStats = config.value("showStats", false);
+
+        // Dynamic resolution is disabled by default. The scaled target has the window size so that any scale fits in it without reallocating
+        this->dynamicResolutionEnabled = config.value("dynamicResolution", false);
+        if(dynamicResolutionEnabled){
+            dynamicResolution.create(config);
+            scaledTarget.create(windowSize, true);
+        }
 
         // Then we check if there is a sky texture in the configuration
         if(config.contains("sky")){
@@ -62,69 +129,101 @@ namespace our {
             this->skyMaterial->transparent = false;
         }
 
-        // Then we check if there is a postprocessing shader in the configuration
+        // Then we check if there are postprocessing passes in the configuration
+        // "postprocess" is either the path of a single fragment shader or an array of passes applied in order. Each pass is either a path or
+        // an object such as { "shader": "path.frag", "scale": 0.5, "uniforms": { "strength": 0.01, "tint": [1, 0, 0] } }
+        std::vector<nlohmann::json> passConfigs;
         if(config.contains("postprocess")){
+            const nlohmann::json& passes = config["postprocess"];
+            if(passes.is_array()) passConfigs.assign(passes.begin(), passes.end());
+            else passConfigs.push_back(passes);
+        }
+        if(!passConfigs.empty()){
             //TODO: (Req 11) Create a framebuffer
-            glGenFramebuffers(1, &postprocessFrameBuffer);
-            glBindFramebuffer(GL_FRAMEBUFFER, postprocessFrameBuffer);
-
-            glGenFramebuffers(1, &this->postprocessFrameBuffer);
-            //bind the framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->postprocessFrameBuffer);
-
             //TODO: (Req 11) Create a color and a depth texture and attach them to the framebuffer
-            // Hints: The color format can be (Red, Green, Blue and Alpha components with 8 bits for each channel).
-            // The depth format can be (Depth component with 24 bits).
-            colorTarget = new Texture2D();
-            
-            auto cT = this->colorTarget->getOpenGLName() ;
-            glGenTextures(1, &cT);
-            glBindTexture(GL_TEXTURE_2D, this->colorTarget->getOpenGLName());
-            GLuint mip_levels = (GLuint)glm::floor(glm::log2(glm::max<float>(float(windowSize.x),float(windowSize.y)))) + 1;
-            glTexStorage2D(GL_TEXTURE_2D, mip_levels, GL_RGBA8, windowSize.x, windowSize.y);
-            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,this->colorTarget->getOpenGLName(), 0);
-            
-            depthTarget = new Texture2D();
-
-            auto dT = this->depthTarget->getOpenGLName() ;
-            glGenTextures(1, &dT);
-            glBindTexture(GL_TEXTURE_2D, this->depthTarget->getOpenGLName());
-            glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, windowSize.x, windowSize.y);
-            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depthTarget->getOpenGLName(), 0);
-           
-            
-            //TODO: (Req 11) Unbind the framebuffer just to be safe
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-            
+            // The scene is drawn to a target with an 8-bit RGBA color texture and a 24-bit depth texture
+            sceneTarget.create(windowSize, true);
 
             // Create a vertex array to use for drawing the texture
             glGenVertexArrays(1, &postProcessVertexArray);
 
             // Create a sampler to use for sampling the scene texture in the post processing shader
-            Sampler* postprocessSampler = new Sampler();
+            postprocessSampler = new Sampler();
             postprocessSampler->set(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             postprocessSampler->set(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             postprocessSampler->set(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             postprocessSampler->set(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-            // Create the post processing shader
-            ShaderProgram* postprocessShader = new ShaderProgram();
-            postprocessShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
-            postprocessShader->attach(config.value<std::string>("postprocess", ""), GL_FRAGMENT_SHADER);
-            postprocessShader->link();
-
-            // Create a post processing material
-            postprocessMaterial = new TexturedMaterial();
-            postprocessMaterial->shader = postprocessShader;
-            postprocessMaterial->texture = colorTarget;
-            postprocessMaterial->sampler = postprocessSampler;
-            // The default options are fine but we don't need to interact with the depth buffer
-            // so it is more performant to disable the depth mask
-            postprocessMaterial->pipelineState.depthMask = false;
+            // Each pass reads the output of the previous pass. The intermediate outputs are taken from the pool,
+            // so a chain of passes with the same scale only needs two targets
+            RenderTarget* input = &sceneTarget;
+            for(size_t i = 0; i < passConfigs.size(); i++){
+                const nlohmann::json& passConfig = passConfigs[i];
+                bool isObject = passConfig.is_object();
+                std::string shaderPath = isObject ? passConfig.value<std::string>("shader", "") : passConfig.get<std::string>();
+
+                // Create the post processing shader
+                ShaderProgram* postprocessShader = new ShaderProgram();
+                postprocessShader->attach("assets/shaders/fullscreen.vert", GL_VERTEX_SHADER);
+                postprocessShader->attach(shaderPath, GL_FRAGMENT_SHADER);
+                postprocessShader->link();
+
+                PostprocessPass pass;
+                pass.scale = isObject ? passConfig.value("scale", 1.0f) : 1.0f;
+                pass.inputSize = input->size;
+                if(i + 1 < passConfigs.size()){
+                    glm::ivec2 size = glm::max(glm::ivec2(glm::vec2(windowSize) * pass.scale), glm::ivec2(1));
+                    pass.output = postprocessTargets.acquire(size, input);
+                } else {
+                    pass.output = nullptr;
+                }
+                if(isObject && passConfig.contains("uniforms")){
+                    for(auto& [name, value] : passConfig["uniforms"].items()){
+                        PostprocessUniform uniform = {ShaderProgram::intern(name), 0, glm::vec4(0.0f)};
+                        if(value.is_number()){
+                            uniform.components = 1;
+                            uniform.value.x = value.get<float>();
+                        } else if(value.is_array() && value.size() >= 2 && value.size() <= 4){
+                            uniform.components = (int)value.size();
+                            for(int component = 0; component < uniform.components; component++) uniform.value[component] = value[component].get<float>();
+                        } else {
+                            std::cerr << "Unsupported value for the postprocess uniform: " << name << std::endl;
+                            continue;
+                        }
+                        pass.uniforms.push_back(uniform);
+                    }
+                }
+
+                // Create a post processing material
+                pass.material = new TexturedMaterial();
+                pass.material->shader = postprocessShader;
+                pass.material->texture = input->color;
+                pass.material->sampler = postprocessSampler;
+                // The default options are fine but we don't need to interact with the depth buffer
+                // so it is more performant to disable the depth mask
+                pass.material->pipelineState.depthMask = false;
+                postprocessPasses.push_back(pass);
+                input = pass.output;
+            }
         }
     }
 
     void ForwardRenderer::destroy(){
+        lightBuffer.destroy();
+        if(clusteredLighting) lightClusters.destroy();
+        instanceBuffer.destroy();
+        delete depthShader;
+        delete depthInstancedShader;
+        depthShader = depthInstancedShader = nullptr;
+        for(auto& [entity, query] : queries) glDeleteQueries(1, &query.query);
+        queries.clear();
+        delete proxyBox;
+        proxyBox = nullptr;
+        if(fragmentStats) glDeleteQueries(SAMPLE_QUERY_COUNT, sampleQueries);
+        if(dynamicResolutionEnabled){
+            dynamicResolution.destroy();
+            scaledTarget.destroy();
+        }
         // Delete all objects related to the sky
         if(skyMaterial){
             delete skySphere;
@@ -134,130 +233,330 @@ namespace our {
             delete skyMaterial;
         }
         // Delete all objects related to post processing
-        if(postprocessMaterial){
-            glDeleteFramebuffers(1, &postprocessFrameBuffer);
+        if(!postprocessPasses.empty()){
+            GLStateCache::forgetVertexArray(postProcessVertexArray);
             glDeleteVertexArrays(1, &postProcessVertexArray);
-            delete colorTarget;
-            delete depthTarget;
-            delete postprocessMaterial->sampler;
-            delete postprocessMaterial->shader;
-            delete postprocessMaterial;
+            sceneTarget.destroy();
+            postprocessTargets.destroy();
+            for(auto& pass : postprocessPasses){
+                delete pass.material->shader;
+                delete pass.material;
+            }
+            postprocessPasses.clear();
+            delete postprocessSampler;
+            postprocessSampler = nullptr;
         }
     }
 
     void ForwardRenderer::render(World* world){
         // First of all, we search for a camera and for all the mesh renderers
         CameraComponent* camera = nullptr;
-        opaqueCommands.clear();
-        transparentCommands.clear();
-        lights.clear();
+        stats = RendererStats();
+        auto cpuStart = std::chrono::high_resolution_clock::now();
+        // The size at which the scene is drawn (it is smaller than the window if dynamic resolution lowered the scale)
+        glm::ivec2 renderSize = dynamicResolutionEnabled ? dynamicResolution.getRenderSize(windowSize) : windowSize;
+
+        // Free all the data of the last frame, then allocate the lists of this frame
+        // Each mesh renderer adds at most one command, so the number of mesh renderers is enough capacity for all the command lists
+        // (the reset itself could allocate if the last frame overflowed the arena, so we start counting before it)
+        uint64_t heapAllocationsAtStart = frameArena.getHeapAllocations();
+        frameArena.reset();
+        // Bring the cached world matrices up to date once for the whole frame (this runs on the main thread)
+        // so the extraction on the worker threads only reads them
+        stats.transformUpdates = world->updateTransforms();
+        auto rendererView = world->view<MeshRendererComponent>();
+        auto lightView = world->view<LightComponent>();
+        size_t capacity = rendererView.size();
+        opaqueCommands = frameArena.allocateList<RenderCommand>(capacity);
+        transparentCommands = frameArena.allocateList<RenderCommand>(capacity);
+        opaqueOrder = frameArena.allocateList<SortEntry>(capacity);
+        transparentOrder = frameArena.allocateList<SortEntry>(capacity);
+        opaqueBatches = frameArena.allocateList<DrawBatch>(capacity);
+        lights = frameArena.allocateList<LightComponent*>(lightView.size());
+
+        // We copy the mesh renderers into an array so that they can be split into ranges (one range per worker)
+        // The views only visit the entities that have the components, so the entities without them cost nothing here
+        MeshRendererComponent** renderers = frameArena.allocateArray<MeshRendererComponent*>(capacity);
+        size_t rendererCount = 0;
+        rendererView.each([&](Entity*, MeshRendererComponent& meshRenderer){ renderers[rendererCount++] = &meshRenderer; });
+        lightView.each([&](Entity*, LightComponent& light){ lights.push_back(&light); });
+
+        // We need the camera before building the commands since we use its frustum to cull the commands
+        Entity* cameraEntity = world->view<CameraComponent>().front();
+        camera = cameraEntity ? cameraEntity->getComponent<CameraComponent>() : nullptr;
 
-        for(auto entity : world->getEntities()){
+        // If there is no camera, we return (we cannot render without a camera)
+        if(camera == nullptr) return;
 
-            if (auto light = entity->getComponent<LightComponent>(); light) {
-                lights.push_back(light);
-            }
-            // If we hadn't found a camera yet, we look for a camera in this entity
-            if(!camera) camera = entity->getComponent<CameraComponent>();
-            // If this entity has a mesh renderer component
-            if(auto meshRenderer = entity->getComponent<MeshRendererComponent>(); meshRenderer){
+        // The camera values that are needed multiple times are computed once per frame
+        glm::mat4 cameraLocalToWorld = camera->getOwner()->getLocalToWorldMatrix();
+        glm::vec3 cameraPosition = glm::vec3(cameraLocalToWorld[3]);
+
+        //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
+        glm::mat4 P = camera->getProjectionMatrix(windowSize);
+        glm::mat4 V = camera->getViewMatrix();
+        glm::mat4 VP = P * V;
+        // The projected size of a sphere depends on its depth only if the projection is perspective
+        bool perspective = P[3][3] == 0.0f;
+
+        // The frustum planes are extracted from VP so they are defined in the world space
+        Frustum frustum = Frustum::fromMatrix(VP);
+
+        //TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
+        // HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
+        // The camera looks along its local -Z. Since this is a direction, w is 0 so that the camera translation is ignored
+        glm::vec3 cameraForward = glm::normalize(glm::vec3(cameraLocalToWorld * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+
+        // Allocate a bucket for every range of mesh renderers. Since each one adds at most one command, the range size is enough capacity
+        size_t rangeSize = workerPool ? workerPool->getRangeSize(rendererCount, minEntitiesPerWorker) : rendererCount;
+        size_t bucketCount = rangeSize ? (rendererCount + rangeSize - 1) / rangeSize : 0;
+        ExtractionBucket* buckets = frameArena.allocateArray<ExtractionBucket>(bucketCount);
+        for(size_t i = 0; i < bucketCount; i++){
+            new (&buckets[i]) ExtractionBucket{
+                frameArena.allocateList<RenderCommand>(rangeSize),
+                frameArena.allocateList<RenderCommand>(rangeSize),
+                occlusionCulling ? frameArena.allocateList<Occluder>(rangeSize) : FrameList<Occluder>(),
+                0, 0
+            };
+        }
+
+        // This extracts the commands from a range of mesh renderers into the bucket of the range
+        // It runs on the worker threads, so it only reads the entities & the camera data and only writes to its own bucket
+        auto extract = [&](size_t begin, size_t end, size_t worker){
+            ExtractionBucket& bucket = buckets[worker];
+            for(size_t i = begin; i < end; i++){
+                MeshRendererComponent* meshRenderer = renderers[i];
                 // We construct a command from it
                 RenderCommand command;
                 command.localToWorld = meshRenderer->getOwner()->getLocalToWorldMatrix();
                 command.center = glm::vec3(command.localToWorld * glm::vec4(0, 0, 0, 1));
                 command.mesh = meshRenderer->mesh;
                 command.material = meshRenderer->material;
-                // if it is transparent, we add it to the transparent commands list
+                command.renderer = meshRenderer;
+                command.occlusionQuery = nullptr;
+                // If the object is outside the camera frustum, we skip it since it won't be visible anyway
+                // We test the sphere first since it is cheaper, then we test the box since it is tighter
+                BoundingSphere sphere = command.mesh->getBoundingSphere().transform(command.localToWorld);
+                if(frustumCulling){
+                    if(!frustum.intersects(sphere) ||
+                       !frustum.intersects(command.mesh->getAABB().transform(command.localToWorld))){
+                        bucket.culled++;
+                        continue;
+                    }
+                }
+                // Only the opaque objects can hide what is behind them
+                if(occlusionCulling && meshRenderer->occluder && !command.material->transparent){
+                    bucket.occluders.push_back({meshRenderer->occluderMesh ? meshRenderer->occluderMesh : command.mesh, command.localToWorld});
+                }
+                // The depth of the center in the view space (the distance along the camera forward)
+                float depth = -(V * glm::vec4(command.center, 1.0f)).z;
+                // Pick the level of detail from the size of the bounding sphere on the screen (relative to the screen height)
+                // The bounds of the full mesh are used for culling since the simplified meshes barely change them
+                if(levelOfDetail && !meshRenderer->lods.empty()){
+                    float screenSize = sphere.radius * P[1][1];
+                    if(perspective) screenSize /= glm::max(depth, camera->near);
+                    command.mesh = meshRenderer->getLodMesh(meshRenderer->selectLod(screenSize));
+                }
+                // if it is transparent, we add it to the transparent commands list with the view depth of its center
                 if(command.material->transparent){
-                    transparentCommands.push_back(command);
+                    command.depth = depth;
+                    bucket.transparent.push_back(command);
                 } else {
-                // Otherwise, we add it to the opaque command list
-                    opaqueCommands.push_back(command);
+                // Otherwise, we add it to the opaque command list with the normalized depth of its center in the view space
+                    command.depth = (depth - camera->near) / (camera->far - camera->near);
+                    bucket.opaque.push_back(command);
                 }
             }
-            
+        };
+        if(workerPool) workerPool->parallelFor(rendererCount, minEntitiesPerWorker, extract);
+        else extract(0, rendererCount, 0);
+
+        // Rasterize the occluders on the CPU, then each range of buckets removes its hidden commands before they are merged
+        if(occlusionCulling){
+            occlusionCuller.begin(VP);
+            for(size_t i = 0; i < bucketCount; i++){
+                for(auto& occluder : buckets[i].occluders){
+                    const auto& positions = occluder.mesh->getPositions();
+                    const auto& elements = occluder.mesh->getElements();
+                    occlusionCuller.addOccluder(positions.data(), positions.size(), elements.data(), elements.size(), occluder.localToWorld);
+                }
+            }
+            occlusionCuller.rasterize(workerPool.get());
+            auto cull = [&](size_t begin, size_t end, size_t){
+                for(size_t i = begin; i < end; i++){
+                    buckets[i].occluded = removeOccluded(buckets[i].opaque) + removeOccluded(buckets[i].transparent);
+                }
+            };
+            if(workerPool) workerPool->parallelFor(bucketCount, 1, cull);
+            else cull(0, bucketCount, 0);
+            stats.occluders = occlusionCuller.getOccluderCount();
+            stats.occluderTriangles = occlusionCuller.getTriangleCount();
         }
 
-        // If there is no camera, we return (we cannot render without a camera)
-        if(camera == nullptr) return;
-
-        //TODO: (Req 9) Modify the following line such that "cameraForward" contains a vector pointing the camera forward direction
-        // HINT: See how you wrote the CameraComponent::getViewMatrix, it should help you solve this one
-        glm::vec3 cameraForward = camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
-
-        std::sort(transparentCommands.begin(), transparentCommands.end(), [cameraForward](const RenderCommand& first, const RenderCommand& second){
-            //TODO: (Req 9) Finish this function
-            // HINT: the following return should return true "first" should be drawn before "second". 
-            // We use the dot product of the camera forward vector and the center of the object to find the distance between them
-            return glm::dot(cameraForward, first.center) < glm::dot(cameraForward, second.center);
-            
-        });
+        // Merge the buckets in order, the sort keys are computed here since assigning the pipeline state ids is not thread safe
+        for(size_t i = 0; i < bucketCount; i++){
+            ExtractionBucket& bucket = buckets[i];
+            for(auto& command : bucket.opaque){
+                assignOcclusionQuery(command);
+                stats.drawnTriangles += command.mesh->getTriangleCount();
+                if(command.mesh != command.renderer->mesh) stats.reducedLodCommands++;
+                opaqueOrder.push_back({computeSortKey(command, command.depth), (uint32_t)opaqueCommands.size()});
+                opaqueCommands.push_back(command);
+            }
+            for(auto& command : bucket.transparent){
+                assignOcclusionQuery(command);
+                stats.drawnTriangles += command.mesh->getTriangleCount();
+                if(command.mesh != command.renderer->mesh) stats.reducedLodCommands++;
+                // Transparent commands are drawn back to front, so the key is the negated view depth (the farthest command gets the smallest key)
+                transparentOrder.push_back({floatToSortableBits(-command.depth), (uint32_t)transparentCommands.size()});
+                transparentCommands.push_back(command);
+            }
+            stats.culledCommands += bucket.culled;
+            stats.occlusionCulled += bucket.occluded;
+        }
+        stats.drawnCommands = opaqueCommands.size() + transparentCommands.size();
+        if(occlusionQueries) releaseStaleQueries();
+
+        // Sort the opaque commands by state first (to minimize the state changes) then front to back (for early depth rejection)
+        radixSort(opaqueOrder.data(), frameArena.allocateArray<SortEntry>(opaqueOrder.size()), opaqueOrder.size());
+
+        // Split the sorted commands into batches of adjacent commands sharing the same mesh & material
+        // Large enough batches whose material has an instanced shader have their transforms collected into the instance buffer
+        instanceBuffer.begin(frameArena, opaqueOrder.size());
+        for(uint32_t first = 0; first < opaqueOrder.size();){
+            const RenderCommand& command = opaqueCommands[opaqueOrder[first].index];
+            uint32_t last = first + 1;
+            while(last < opaqueOrder.size()){
+                const RenderCommand& next = opaqueCommands[opaqueOrder[last].index];
+                // A queried command is drawn on its own since its draw depends on its own query
+                if(next.mesh != command.mesh || next.material != command.material || next.occlusionQuery || command.occlusionQuery) break;
+                last++;
+            }
+            uint32_t count = last - first;
+            if(instancing && command.material->instancedShader && count >= (uint32_t)minInstances){
+                bool needsNormals = dynamic_cast<LitMaterial*>(command.material) != nullptr;
+                opaqueBatches.push_back({first, count, instanceBuffer.size(), true});
+                for(uint32_t i = first; i < last; i++){
+                    instanceBuffer.add(opaqueCommands[opaqueOrder[i].index].localToWorld, needsNormals);
+                }
+            } else {
+                opaqueBatches.push_back({first, count, 0, false});
+            }
+            first = last;
+        }
+        instanceBuffer.upload();
+
+        // Upload the lights once for the whole frame, all the lit draws read them from the same uniform buffer
+        if(clusteredLighting){
+            // Only the lights that reach everything are kept in the uniform buffer, the rest are assigned to the clusters they overlap
+            globalLights = frameArena.allocateList<LightComponent*>(lights.size());
+            clusteredLights = frameArena.allocateList<LightComponent*>(lights.size());
+            for(auto light : lights){
+                if(std::isinf(computeLightRange(light))) globalLights.push_back(light);
+                else clusteredLights.push_back(light);
+            }
+            lightClusters.update(clusteredLights.data(), clusteredLights.size(), V, P, camera->near, camera->far,
+                                 renderSize, cameraForward, workerPool.get());
+            lightBuffer.update(globalLights.data(), globalLights.size(), &lightClusters.getParameters());
+            stats.clusteredLights = clusteredLights.size();
+            stats.clusterLightIndices = lightClusters.getIndexCount();
+        } else {
+            lightBuffer.update(lights.data(), lights.size());
+        }
+        // The influence of every uploaded light is computed once, then it is tested against the bounds of every lit draw
+        if(objectLightCulling){
+            lightInfluences = frameArena.allocateList<LightInfluence>(lightBuffer.getCount());
+            for(int i = 0; i < lightBuffer.getCount(); i++){
+                const LightData& data = lightBuffer.getLight(i);
+                lightInfluences.push_back(LightInfluence::make(lights[i], data.position, data.direction));
+            }
+        }
 
-        //TODO: (Req 9) Get the camera ViewProjection matrix and store it in VP
-        glm::mat4 P = camera->getProjectionMatrix(windowSize);
-        glm::mat4 V = camera->getViewMatrix();
-        glm::mat4 VP = P * V;
+        //TODO: (Req 9) Draw the transparent commands sorted by their sort key
+        // HINT: the entry that should be drawn first has the smaller key
+        // We only sort the key & index pairs (the keys were computed once during the extraction), the commands themselves are not moved
+        radixSort(transparentOrder.data(), frameArena.allocateArray<SortEntry>(transparentOrder.size()), transparentOrder.size());
 
-    
-        
         //TODO: (Req 9) Set the OpenGL viewport using viewportStart and viewportSize
-        glViewport(0, 0, windowSize.x, windowSize.y);
+        glViewport(0, 0, renderSize.x, renderSize.y);
         
         //TODO: (Req 9) Set the clear color to black and the clear depth to 1
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClearDepth(1.0f);
         
         //TODO: (Req 9) Set the color mask to true and the depth mask to true (to ensure the glClear will affect the framebuffer)
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-        glDepthMask(GL_TRUE);
+        GLStateCache::colorMask(glm::bvec4(true));
+        GLStateCache::depthMask(true);
    
 
         // If there is a postprocess material, bind the framebuffer
-        if(postprocessMaterial){
+        if(!postprocessPasses.empty()){
             //TODO: (Req 11) bind the framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->postprocessFrameBuffer);  
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sceneTarget.framebuffer);
+        }
+        // With dynamic resolution, the scene is drawn to the scaled target first (then it is upscaled after the transparent objects)
+        if(dynamicResolutionEnabled){
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scaledTarget.framebuffer);
+            dynamicResolution.beginGpuTimer();
         }
 
         //TODO: (Req 9) Clear the color and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
+        // If enabled, fill the depth buffer first so that the color pass only shades the visible fragments
+        if(depthPrepass){
+            GpuProfiler::ScopedTimer timer(gpuScopes.depthPrepass);
+            drawDepthPrepass(VP);
+        }
+
+        // Read the oldest sample query (if its result is ready) then start counting the samples of this frame
+        if(fragmentStats){
+            int oldest = (sampleQueryIndex + 1) % SAMPLE_QUERY_COUNT;
+            if(sampleQueryPending[oldest]){
+                GLuint available = 0;
+                glGetQueryObjectuiv(sampleQueries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+                if(available){
+                    GLuint64 samples = 0;
+                    glGetQueryObjectui64v(sampleQueries[oldest], GL_QUERY_RESULT, &samples);
+                    lastShadedSamples = samples;
+                    sampleQueryPending[oldest] = false;
+                }
+            }
+            glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[sampleQueryIndex]);
+        }
+        GpuProfiler::begin(gpuScopes.opaque);
+
         //TODO: (Req 9) Draw all the opaque commands
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for(auto command : opaqueCommands){
-            command.material->setup();
-
-            //check if material is litMaterial
-            if(auto litMaterial = dynamic_cast<LitMaterial*>(command.material); litMaterial)
-            {
-                //set the lights
-                litMaterial->shader->set("object_to_world", command.localToWorld);
-                litMaterial->shader->set("object_to_wolrd_inv_transpose", glm::inverse(glm::transpose(command.localToWorld)));
-                litMaterial->shader->set("view_projection", VP);
-                litMaterial->shader->set("camera_position", camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                litMaterial->shader->set("light_count", (int)lights.size());
-                
-                for(int i = 0; i < lights.size(); i++){
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].position", lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                    litMaterial->shader->set("lights["+ std::to_string(i) + "].direction", lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f));
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].diffuse", lights[i]->diffuse);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].specular", lights[i]->specular);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].type", (int)lights[i]->type);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].attenuation", lights[i]->attenuation);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].cone_angles", lights[i]->cone_angles);
+        // The opaque commands are drawn in the order of their sort keys so that draws sharing the same state are adjacent
+        DrawContext context;
+        context.VP = VP;
+        context.cameraPosition = cameraPosition;
+        for(auto& batch : opaqueBatches){
+            if(batch.instanced){
+                drawInstancedBatch(batch, context);
+            } else {
+                for(uint32_t i = batch.first; i < batch.first + batch.count; i++){
+                    drawCommand(opaqueCommands[opaqueOrder[i].index], context);
                 }
             }
-            else{ 
-                command.material->shader->set("transform", VP * command.localToWorld);
-            }
-            command.mesh->draw();
+        }
+
+        GpuProfiler::end(gpuScopes.opaque);
+        if(fragmentStats){
+            glEndQuery(GL_SAMPLES_PASSED);
+            sampleQueryPending[sampleQueryIndex] = true;
+            sampleQueryIndex = (sampleQueryIndex + 1) % SAMPLE_QUERY_COUNT;
+            stats.shadedSamples = lastShadedSamples;
         }
         
         // If there is a sky material, draw the sky
         if(this->skyMaterial){
+            GpuProfiler::ScopedTimer timer(gpuScopes.sky);
             //TODO: (Req 10) setup the sky material
             skyMaterial->setup(); 
             //TODO: (Req 10) Get the camera position
-            glm::mat4 cameraPosition = camera->getOwner()->getLocalToWorldMatrix();
+            // (we use the camera matrix that we computed at the start of the frame)
             
             //TODO: (Req 10) We want the sky to be drawn behind everything (in NDC space, z=1)
             // We can acheive the is by multiplying by an extra matrix after the projection but what values should we put in it?
@@ -269,7 +568,7 @@ namespace our {
             );
 
             //TODO: (Req 10) set the "transform" uniform
-            skyMaterial->shader->set("transform", alwaysBehindTransform* VP * cameraPosition);   
+            skyMaterial->shader->set(uniforms.transform, alwaysBehindTransform* VP * cameraLocalToWorld);   
             
             //TODO: (Req 10) draw the sky sphere
             skySphere->draw();
@@ -277,52 +576,342 @@ namespace our {
         }
         //TODO: (Req 9) Draw all the transparent commands
         // Don't forget to set the "transform" uniform to be equal the model-view-projection matrix for each render command
-        for(auto command : transparentCommands){
-            command.material->setup();
-
-            //check if material is litMaterial
-            if(auto litMaterial = dynamic_cast<LitMaterial*>(command.material); litMaterial){
-                //set the lights
-                litMaterial->shader->set("object_to_world", command.localToWorld);
-                litMaterial->shader->set("object_to_wolrd_inv_transpose", glm::inverse(glm::transpose(command.localToWorld)));
-                litMaterial->shader->set("view_projection", VP);
-                litMaterial->shader->set("camera_position", camera->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                litMaterial->shader->set("light_count", (int)lights.size());
-                for(int i = 0; i < lights.size(); i++){
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].position", lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                    litMaterial->shader->set("lights["+ std::to_string(i) + "].direction", lights[i]->getOwner()->getLocalToWorldMatrix() * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f));
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].diffuse", lights[i]->diffuse);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].specular", lights[i]->specular);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].type", (int)lights[i]->type);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].attenuation", lights[i]->attenuation);
-                    litMaterial->shader->set("lights[" + std::to_string(i) + "].cone_angles", lights[i]->cone_angles);
-                }
-            }
-            else{ 
-                command.material->shader->set("transform", VP * command.localToWorld);
+        // The sky changed the OpenGL state, so the transparent commands start with a fresh context
+        // Their order is decided by the depth sort, but adjacent commands can still share their setup
+        context = DrawContext();
+        context.VP = VP;
+        context.cameraPosition = cameraPosition;
+        GpuProfiler::begin(gpuScopes.transparent);
+        for(auto& entry : transparentOrder){
+            drawCommand(transparentCommands[entry.index], context);
+        }
+        GpuProfiler::end(gpuScopes.transparent);
+
+        // Now that the depth of the whole scene is drawn, test the bounds of the queried objects against it for the next frame
+        if(occlusionQueries){
+            GpuProfiler::ScopedTimer timer(gpuScopes.occlusionQueries);
+            // The distance from the camera to the farthest corner of the near plane. A box closer than that could be clipped by the near plane
+            glm::mat4 inverseVP = glm::inverse(VP);
+            float nearRadius = 0;
+            for(int corner = 0; corner < 4; corner++){
+                glm::vec4 point = inverseVP * glm::vec4((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, -1.0f, 1.0f);
+                nearRadius = glm::max(nearRadius, glm::distance(glm::vec3(point) / point.w, cameraPosition));
             }
-            command.mesh->draw();
+            drawOcclusionProxies(VP, cameraPosition, nearRadius);
+        }
+
+        // Upscale the scene to the window size, the blit uses linear filtering so the result is as smooth as a bilinear upscale
+        if(dynamicResolutionEnabled){
+            GpuProfiler::ScopedTimer timer(gpuScopes.upscale);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, scaledTarget.framebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, postprocessPasses.empty() ? 0 : sceneTarget.framebuffer);
+            glBlitFramebuffer(0, 0, renderSize.x, renderSize.y, 0, 0, windowSize.x, windowSize.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            glViewport(0, 0, windowSize.x, windowSize.y);
         }
         
 
-        // If there is a postprocess material, apply postprocessing
-        if(postprocessMaterial){
-            //TODO: (Req 11) Return to the default framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-            
-            //TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
-            postprocessMaterial->setup();
-            glBindVertexArray(postProcessVertexArray);
-            glDrawArrays(GL_TRIANGLES, 0, 3);
-            glBindVertexArray(0);
-            glEnable(GL_DEPTH_TEST);
+        // If there are postprocess passes, apply them in order
+        if(!postprocessPasses.empty()){
+            GpuProfiler::ScopedTimer timer(gpuScopes.postprocess);
+            GLStateCache::bindVertexArray(postProcessVertexArray);
+            for(auto& pass : postprocessPasses){
+                //TODO: (Req 11) Return to the default framebuffer
+                // Only the last pass draws to the default framebuffer, the others draw to their pooled target
+                if(pass.output){
+                    pass.output->bind();
+                } else {
+                    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                    glViewport(0, 0, windowSize.x, windowSize.y);
+                }
 
-            
+                //TODO: (Req 11) Setup the postprocess material and draw the fullscreen triangle
+                pass.material->setup();
+                ShaderProgram* program = pass.material->shader;
+                program->set(uniforms.texelSize, 1.0f / glm::vec2(pass.inputSize));
+                for(auto& uniform : pass.uniforms){
+                    switch(uniform.components){
+                        case 1: program->set(uniform.id, uniform.value.x); break;
+                        case 2: program->set(uniform.id, glm::vec2(uniform.value)); break;
+                        case 3: program->set(uniform.id, glm::vec3(uniform.value)); break;
+                        default: program->set(uniform.id, uniform.value); break;
+                    }
+                }
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            GLStateCache::bindVertexArray(0);
+            GLStateCache::setCapability(GL_DEPTH_TEST, true);
         }
         if (lightMaterial)
         {
             lightMaterial->setup();
         }
+
+        // The scale of the next frame is picked using the time of this frame
+        stats.cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cpuStart).count();
+        if(dynamicResolutionEnabled){
+            dynamicResolution.endGpuTimer();
+            dynamicResolution.update(stats.cpuTime);
+            stats.resolutionScale = (float)renderSize.x / windowSize.x;
+            stats.frameBudget = dynamicResolution.getBudget();
+            stats.gpuTime = dynamicResolution.getGpuTime();
+        }
+
+        stats.frameBytes = frameArena.getUsedBytes();
+        stats.heapAllocations = (size_t)(frameArena.getHeapAllocations() - heapAllocationsAtStart);
+    }
+
+    uint32_t ForwardRenderer::getPipelineStateId(const PipelineState& state){
+        // Each unique pipeline state gets the next available id the first time it is seen
+        auto [it, inserted] = pipelineStateIds.try_emplace(state, (uint32_t)pipelineStateIds.size());
+        return it->second;
+    }
+
+    uint64_t ForwardRenderer::computeSortKey(const RenderCommand& command, float depth){
+        // The key is packed as follows (from the most significant bit to the least significant bit):
+        // | pipeline state (10 bits) | shader (10 bits) | material (14 bits) | mesh (14 bits) | depth (16 bits) |
+        // So sorting by the key groups the commands by their state first, then orders each group from front to back
+        // Ids that exceed their bit budget wrap around, which only makes the grouping less perfect (it can never cause wrong rendering)
+        uint64_t pipeline = getPipelineStateId(command.material->pipelineState) & 0x3FF;
+        uint64_t shader = command.material->shader->getOpenGLName() & 0x3FF;
+        uint64_t material = command.material->getId() & 0x3FFF;
+        uint64_t mesh = command.mesh->getVertexArray() & 0x3FFF;
+        uint64_t quantizedDepth = (uint64_t)(glm::clamp(depth, 0.0f, 1.0f) * 0xFFFF);
+        return (pipeline << 54) | (shader << 44) | (material << 30) | (mesh << 16) | quantizedDepth;
+    }
+
+    void ForwardRenderer::applyMaterial(Material* material, ShaderProgram* program, DrawContext& context){
+        // If the material (or the program) changed since the last draw, we only apply the parts of its setup that changed
+        if(material == context.material && program == context.shader) return;
+        // Materials that were drawn in the depth pre-pass are drawn on top of their own depth, so they use GL_EQUAL with no depth writes
+        bool equalDepth = usesDepthPrepass(material);
+        if(context.pipelineState == nullptr || *context.pipelineState != material->pipelineState || context.equalDepth != equalDepth){
+            material->pipelineState.setup();
+            if(equalDepth){
+                GLStateCache::depthFunc(GL_EQUAL);
+                GLStateCache::depthMask(false);
+            }
+            context.pipelineState = &material->pipelineState;
+            context.equalDepth = equalDepth;
+        }
+        if(program != context.shader){
+            program->use();
+            context.shader = program;
+            // The uniforms that are the same for the whole frame are stored in the program,
+            // so we only need to send them when we switch to a different program (programs that don't use them will ignore them)
+            program->set(uniforms.viewProjection, context.VP);
+            program->set(uniforms.cameraPosition, context.cameraPosition);
+            program->set(uniforms.objectLightsEnabled, (GLint)objectLightCulling);
+        }
+        material->setupParameters(program);
+        context.material = material;
+        context.litMaterial = dynamic_cast<LitMaterial*>(material);
+    }
+
+    void ForwardRenderer::drawCommand(const RenderCommand& command, DrawContext& context){
+        Material* material = command.material;
+        applyMaterial(material, material->shader, context);
+
+        // All the shaders compute the position using "transform" (so that it matches the depth pre-pass exactly)
+        material->shader->set(uniforms.transform, context.VP * command.localToWorld);
+        //check if material is litMaterial
+        if(context.litMaterial){
+            material->shader->set(uniforms.objectToWorld, command.localToWorld);
+            // Only the 3x3 inverse transpose is needed to transform the normals
+            material->shader->set(uniforms.objectToWorldInvTranspose, matrix_utils::normalMatrix(command.localToWorld));
+            if(objectLightCulling) setObjectLights(material->shader, command.mesh->getBoundingSphere().transform(command.localToWorld));
+        }
+        bool conditional = beginConditionalRender(command);
+        // A conditionally drawn object was not drawn in the depth pre-pass (see drawDepthPrepass), so it can't use GL_EQUAL
+        // It writes its own depth instead, so the depth & the color of the object are decided by the same conditional render
+        bool ownDepth = conditional && context.equalDepth;
+        if(ownDepth){
+            GLStateCache::depthFunc(material->pipelineState.depthTesting.function);
+            GLStateCache::depthMask(true);
+        }
+        command.mesh->draw();
+        if(conditional) glEndConditionalRender();
+        if(ownDepth){
+            GLStateCache::depthFunc(GL_EQUAL);
+            GLStateCache::depthMask(false);
+        }
+        stats.drawCalls++;
+    }
+
+    void ForwardRenderer::drawInstancedBatch(const DrawBatch& batch, DrawContext& context){
+        const RenderCommand& command = opaqueCommands[opaqueOrder[batch.first].index];
+        applyMaterial(command.material, command.material->instancedShader, context);
+        // The transforms are read from the instance buffer, so the only thing left is to point the mesh to the batch instances
+        instanceBuffer.attachToMesh(command.mesh, batch.firstInstance);
+        // All the instances share one light list, so we pick the lights using a sphere that contains all of them
+        if(objectLightCulling && context.litMaterial){
+            BoundingSphere bounds = command.mesh->getBoundingSphere().transform(command.localToWorld);
+            for(uint32_t i = batch.first + 1; i < batch.first + batch.count; i++){
+                const RenderCommand& instance = opaqueCommands[opaqueOrder[i].index];
+                BoundingSphere sphere = instance.mesh->getBoundingSphere().transform(instance.localToWorld);
+                // Grow the sphere just enough to contain the other sphere
+                float distance = glm::distance(bounds.center, sphere.center);
+                if(distance + sphere.radius <= bounds.radius) continue;
+                if(distance + bounds.radius <= sphere.radius){ bounds = sphere; continue; }
+                float radius = (distance + bounds.radius + sphere.radius) * 0.5f;
+                bounds.center += (sphere.center - bounds.center) * ((radius - bounds.radius) / distance);
+                bounds.radius = radius;
+            }
+            setObjectLights(command.material->instancedShader, bounds);
+        }
+        command.mesh->drawInstanced(batch.count);
+        stats.drawCalls++;
+    }
+
+    void ForwardRenderer::setObjectLights(ShaderProgram* program, const BoundingSphere& sphere){
+        ObjectLights objectLights;
+        objectLights.select(lightInfluences.data(), lightInfluences.size(), sphere);
+        program->set(uniforms.objectLightCount, objectLights.count);
+        if(objectLights.count > 0) program->set(uniforms.objectLights, objectLights.indices, objectLights.count);
+    }
+
+    void ForwardRenderer::assignOcclusionQuery(RenderCommand& command){
+        if(!occlusionQueries) return;
+        OcclusionQueryMode mode = command.renderer->occlusionQuery;
+        if(mode == OcclusionQueryMode::NEVER) return;
+        if(mode == OcclusionQueryMode::AUTO && command.mesh->getTriangleCount() < minQueryTriangles) return;
+        OcclusionQuery& query = queries[command.renderer->getOwner()];
+        if(query.query == 0) glGenQueries(1, &query.query);
+        // If the query was not issued last frame (the object was culled or not queried), its result is stale, so it is not used
+        if(query.lastFrame + 1 != frameIndex) query.issued = false;
+        query.lastFrame = frameIndex;
+        command.occlusionQuery = &query;
+    }
+
+    bool ForwardRenderer::isConditional(const RenderCommand& command) const {
+        return command.occlusionQuery && command.occlusionQuery->issued;
+    }
+
+    bool ForwardRenderer::beginConditionalRender(const RenderCommand& command){
+        if(!isConditional(command)) return false;
+        // If the result is not ready yet, the GPU draws the object instead of waiting for it
+        glBeginConditionalRender(command.occlusionQuery->query, GL_QUERY_NO_WAIT);
+        return true;
+    }
+
+    void ForwardRenderer::drawOcclusionProxies(const glm::mat4& VP, const glm::vec3& cameraPosition, float nearRadius){
+        proxyPipelineState.setup();
+        depthShader->use();
+        auto drawProxies = [&](FrameList<RenderCommand>& commands){
+            for(auto& command : commands){
+                OcclusionQuery* query = command.occlusionQuery;
+                if(!query) continue;
+                // If the near plane could cut the box, the visible part of the box could be clipped away although the object is visible
+                // So we don't query the object and the next frame draws it unconditionally
+                AABB box = command.mesh->getAABB().transform(command.localToWorld);
+                if(glm::all(glm::greaterThan(cameraPosition, box.min - nearRadius)) && glm::all(glm::lessThan(cameraPosition, box.max + nearRadius))){
+                    query->issued = false;
+                    continue;
+                }
+                // The proxy is the cube scaled to the local bounds of the mesh (a tiny extent is kept so that flat meshes still cover some pixels)
+                const AABB& bounds = command.mesh->getAABB();
+                glm::mat4 boxToLocal = glm::scale(glm::translate(glm::mat4(1.0f), bounds.getCenter()), glm::max(bounds.getExtents(), glm::vec3(1e-3f)));
+                depthShader->set(uniforms.transform, VP * command.localToWorld * boxToLocal);
+                glBeginQuery(GL_ANY_SAMPLES_PASSED, query->query);
+                proxyBox->draw();
+                glEndQuery(GL_ANY_SAMPLES_PASSED);
+                query->issued = true;
+                stats.occlusionQueries++;
+            }
+        };
+        drawProxies(opaqueCommands);
+        drawProxies(transparentCommands);
+        // Restore the color & depth writes since the code drawn after the renderer (e.g. ImGui) expects them to be enabled
+        GLStateCache::colorMask(glm::bvec4(true));
+        GLStateCache::depthMask(true);
+    }
+
+    void ForwardRenderer::releaseStaleQueries(){
+        // The map is only scanned once in a while since the objects are rarely removed
+        frameIndex++;
+        if(frameIndex % 64 != 0) return;
+        for(auto it = queries.begin(); it != queries.end();){
+            if(it->second.lastFrame + 64 < frameIndex){
+                glDeleteQueries(1, &it->second.query);
+                it = queries.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+
+    size_t ForwardRenderer::removeOccluded(FrameList<RenderCommand>& commands) const {
+        // The visible commands are moved to the front of the list (keeping their order) then the rest is dropped
+        size_t kept = 0;
+        for(size_t i = 0; i < commands.size(); i++){
+            const RenderCommand& command = commands[i];
+            if(!occlusionCuller.isVisible(command.mesh->getAABB().transform(command.localToWorld))) continue;
+            if(kept != i) commands[kept] = command;
+            kept++;
+        }
+        size_t removed = commands.size() - kept;
+        commands.truncate(kept);
+        return removed;
+    }
+
+    bool ForwardRenderer::usesDepthPrepass(const Material* material) const {
+        const PipelineState& state = material->pipelineState;
+        return depthPrepass && !material->transparent && state.depthTesting.enabled && state.depthMask && !state.blending.enabled;
+    }
+
+    void ForwardRenderer::drawDepthPrepass(const glm::mat4& VP){
+        const PipelineState* appliedState = nullptr;
+        for(auto& batch : opaqueBatches){
+            const RenderCommand& first = opaqueCommands[opaqueOrder[batch.first].index];
+            Material* material = first.material;
+            if(!usesDepthPrepass(material)) continue;
+            // We keep the face culling & the depth function of the material but we don't write any color
+            if(appliedState == nullptr || *appliedState != material->pipelineState){
+                material->pipelineState.setup();
+                GLStateCache::colorMask(glm::bvec4(false));
+                appliedState = &material->pipelineState;
+            }
+            if(batch.instanced){
+                depthInstancedShader->use();
+                depthInstancedShader->set(uniforms.viewProjection, VP);
+                instanceBuffer.attachToMesh(first.mesh, batch.firstInstance);
+                first.mesh->drawInstanced(batch.count);
+                stats.drawCalls += 1;
+            } else {
+                depthShader->use();
+                for(uint32_t i = batch.first; i < batch.first + batch.count; i++){
+                    const RenderCommand& command = opaqueCommands[opaqueOrder[i].index];
+                    // The conditionally drawn objects are skipped, since a second conditional render could get a different result
+                    // than the one in the color pass. The color pass draws them with their own depth test & writes instead
+                    if(isConditional(command)) continue;
+                    depthShader->set(uniforms.transform, VP * command.localToWorld);
+                    command.mesh->draw();
+                    stats.drawCalls++;
+                }
+            }
+        }
+        // Restore the color mask for the color pass (the materials will set it anyway, but the sky and post processing rely on it)
+        GLStateCache::colorMask(glm::bvec4(true));
+    }
+
+    void ForwardRenderer::onImmediateGui(){
+        if(!showStats) return;
+        ImGui::Begin("Renderer Stats");
+        ImGui::Text("Drawn commands: %zu", stats.drawnCommands);
+        ImGui::Text("Culled commands: %zu", stats.culledCommands);
+        ImGui::Text("Transform updates: %zu", stats.transformUpdates);
+        if(occlusionQueries) ImGui::Text("Occlusion queries: %zu", stats.occlusionQueries);
+        if(occlusionCulling) ImGui::Text("Occlusion culled: %zu (%zu occluders, %zu triangles)", stats.occlusionCulled, stats.occluders, stats.occluderTriangles);
+        ImGui::Text("Draw calls: %zu", stats.drawCalls);
+        ImGui::Text("Drawn triangles: %zu (%zu commands at a lower level of detail)", stats.drawnTriangles, stats.reducedLodCommands);
+        ImGui::Text("Depth pre-pass: %s", depthPrepass ? "on" : "off");
+        if(dynamicResolutionEnabled){
+            ImGui::Text("Resolution scale: %.0f%% (budget %.2f ms, CPU %.2f ms, GPU %.2f ms)", stats.resolutionScale * 100.0f, stats.frameBudget, stats.cpuTime, stats.gpuTime);
+        }
+        if(clusteredLighting) ImGui::Text("Clustered lights: %zu (%zu cluster entries)", stats.clusteredLights, stats.clusterLightIndices);
+        if(fragmentStats) ImGui::Text("Shaded samples: %llu", (unsigned long long)stats.shadedSamples);
+        ImGui::Text("Frame arena: %zu bytes, %zu heap allocations", stats.frameBytes, stats.heapAllocations);
+        ImGui::End();
     }
 
-}
\ No newline at end of file
+}
@@ -5,22 +5,75 @@
 #include "../components/mesh-renderer.hpp"
 #include "../components/light.hpp"
 #include "../asset-loader.hpp"
+#include "frustum.hpp"
+#include "radix-sort.hpp"
+#include "light-buffer.hpp"
+#include "light-clusters.hpp"
+#include "light-selection.hpp"
+#include "instance-buffer.hpp"
+#include "render-target.hpp"
+#include "dynamic-resolution.hpp"
+#include "occlusion-culler.hpp"
+#include "../frame-arena.hpp"
+#include "../worker-pool.hpp"
+#include "../gpu-profiler.hpp"
 
 #include <glad/gl.h>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <memory>
 
 namespace our
 {
     
+    // The state of the hardware occlusion query of an object. It lives across frames (the renderer keeps one for every queried mesh renderer)
+    struct OcclusionQuery {
+        GLuint query = 0;
+        // True if the query was issued in the last frame, so its result can decide whether the object is drawn
+        bool issued = false;
+        // The last frame in which the object was queried (the queries of the objects that are gone are deleted after a while)
+        uint64_t lastFrame = 0;
+    };
+
     // The render command stores command that tells the renderer that it should draw
     // the given mesh at the given localToWorld matrix using the given material
     // The renderer will fill this struct using the mesh renderer components
     struct RenderCommand {
         glm::mat4 localToWorld;
         glm::vec3 center;
+        // The value used to order the command: the normalized view depth for opaque commands
+        // and the view depth (the distance from the camera along its forward direction) for transparent commands
+        float depth;
         Mesh* mesh;
         Material* material;
+        // The component that made this command
+        MeshRendererComponent* renderer;
+        // If not null, the command is only drawn if the last issued query of its object found it visible
+        OcclusionQuery* occlusionQuery;
+    };
+
+    // This struct holds some statistics about the last frame drawn by the renderer
+    struct RendererStats {
+        size_t drawnCommands = 0;  // The number of commands that passed the culling tests and were drawn
+        size_t transformUpdates = 0;// The number of world matrices recomputed by the transform update pass (the entities that moved & their descendants)
+        size_t culledCommands = 0; // The number of commands that were skipped since they are outside the camera frustum
+        size_t occlusionCulled = 0;// The number of commands that were skipped since they are hidden behind the occluders
+        size_t occluders = 0;      // The number of occluders rasterized by the occlusion culling
+        size_t occluderTriangles = 0;// The number of occluder triangles that were rasterized
+        size_t drawnTriangles = 0;  // The number of triangles in the meshes of the drawn commands (after picking their levels of detail)
+        size_t reducedLodCommands = 0;// The number of commands drawn using a simplified mesh (a level of detail other than the full mesh)
+        size_t occlusionQueries = 0;// The number of commands drawn under a hardware occlusion query
+        size_t drawCalls = 0;      // The number of draw calls issued for the commands (an instanced draw call draws many commands)
+        uint64_t shadedSamples = 0;// The number of samples that passed the depth test in the opaque color pass (read from a query of an earlier frame)
+        size_t frameBytes = 0;     // The number of bytes allocated from the frame arena to draw the frame
+        size_t heapAllocations = 0;// The number of heap allocations made by the frame arena while drawing the frame (it should be 0 in the steady state)
+        size_t clusteredLights = 0;// The number of lights assigned to the clusters (only when clustered lighting is enabled)
+        size_t clusterLightIndices = 0;// The number of light indices in all the clusters (a light is counted once for every cluster it overlaps)
+        float resolutionScale = 1.0f;  // The scale of the resolution at which the scene was drawn (relative to the window size)
+        float frameBudget = 0.0f;      // The frame time (in milliseconds) targeted by the dynamic resolution (0 if it is disabled)
+        double cpuTime = 0;            // The CPU time (in milliseconds) spent in "render"
+        double gpuTime = 0;            // The GPU time (in milliseconds) of the scene as measured by the dynamic resolution (read a few frames late)
     };
 
     // A forward renderer is a renderer that draw the object final color directly to the framebuffer
@@ -30,19 +83,197 @@ namespace our
     class ForwardRenderer {
         // These window size will be used on multiple occasions (setting the viewport, computing the aspect ratio, etc.)
         glm::ivec2 windowSize;
-        // These are two vectors in which we will store the opaque and the transparent commands.
-        // We define them here (instead of being local to the "render" function) as an optimization to prevent reallocating them every frame
-        std::vector<RenderCommand> opaqueCommands;
-        std::vector<RenderCommand> transparentCommands;
+        // All the data that only lives for a single frame (commands, sort entries, batches, lights, instances) is allocated from this arena
+        // It is reset at the start of every frame, so after the first few frames drawing doesn't allocate any memory from the heap
+        FrameArena frameArena;
+        // These are two lists in which we will store the opaque and the transparent commands (allocated from the frame arena)
+        FrameList<RenderCommand> opaqueCommands;
+        FrameList<RenderCommand> transparentCommands;
+        // The order in which the commands are drawn. Each entry holds the sort key of a command and its index in the command list
+        // Sorting these small entries is much cheaper than moving the commands themselves
+        FrameList<SortEntry> opaqueOrder, transparentOrder;
+        // Each unique pipeline state is given a small integer id to be packed into the sort keys
+        std::unordered_map<PipelineState, uint32_t> pipelineStateIds;
         // Objects used for rendering a skybox
         Mesh* skySphere;
         TexturedMaterial* skyMaterial;
         // Objects used for Postprocessing
-        GLuint postprocessFrameBuffer, postProcessVertexArray;
-        Texture2D *colorTarget, *depthTarget;
-        TexturedMaterial* postprocessMaterial;
-        std::vector <LightComponent *> lights;
+        // The scene is drawn to "sceneTarget", then each pass reads the output of the previous pass and the last pass draws to the window
+        GLuint postProcessVertexArray = 0;
+        RenderTarget sceneTarget;
+        RenderTargetPool postprocessTargets;
+        Sampler* postprocessSampler = nullptr;
+        // A uniform value given to a postprocess pass in the configuration (a float or a vector of 2 to 4 floats)
+        struct PostprocessUniform {
+            UniformId id;
+            int components;
+            glm::vec4 value;
+        };
+        struct PostprocessPass {
+            TexturedMaterial* material;
+            // The size of the pass output relative to the window size (it is ignored for the last pass)
+            float scale;
+            // The target this pass draws to, it is null for the last pass (which draws to the window)
+            RenderTarget* output;
+            // The size of the texture that this pass reads
+            glm::ivec2 inputSize;
+            std::vector<PostprocessUniform> uniforms;
+        };
+        std::vector<PostprocessPass> postprocessPasses;
+        // If true, the scene is drawn to the bottom left part of "scaledTarget" at a resolution picked by "dynamicResolution"
+        // to keep the frame time within a budget, then it is upscaled (by a blit) to the window (or to the scene target if there is postprocessing)
+        bool dynamicResolutionEnabled = false;
+        DynamicResolution dynamicResolution;
+        RenderTarget scaledTarget;
+        FrameList<LightComponent*> lights;
+        // The worker threads used to extract the commands & lights from the entities in parallel
+        // If it is null (disabled from the configuration), the extraction runs on the calling thread only
+        std::unique_ptr<WorkerPool> workerPool;
+        // The minimum number of entities given to a worker (for small scenes, waking up the workers costs more than the extraction itself)
+        int minEntitiesPerWorker = 512;
+        // An object that hides the objects behind it in the occlusion culling
+        struct Occluder {
+            const Mesh* mesh;
+            glm::mat4 localToWorld;
+        };
+        // Each worker writes what it extracts from its range of the entities into its own bucket, so the workers never write to the same list
+        // The buckets are merged afterwards (in order) on the main thread
+        struct ExtractionBucket {
+            FrameList<RenderCommand> opaque, transparent;
+            FrameList<Occluder> occluders;
+            size_t culled, occluded;
+        };
+        // If true, the occluders are rasterized on the CPU every frame and the commands hidden behind them are not drawn (see OcclusionCuller)
+        bool occlusionCulling = false;
+        OcclusionCuller occlusionCuller;
+        // The uniform buffer to which the lights are uploaded once per frame
+        LightBuffer lightBuffer;
+        // If true, the lights with a limited range are assigned to the clusters of the view frustum every frame
+        // and each fragment only evaluates the lights of its cluster, so the number of these lights is not limited by MAX_LIGHTS
+        bool clusteredLighting = false;
+        LightClusters lightClusters;
+        // The lights that reach every cluster (directional & unattenuated lights) and the lights that are assigned to the clusters
+        FrameList<LightComponent*> globalLights, clusteredLights;
+        // If true (and clustered lighting is disabled), each lit draw only evaluates the strongest lights that can reach its bounding sphere
+        // instead of all the lights in the uniform block (see ObjectLights)
+        bool objectLightCulling = false;
+        // The influence of each light in the uniform block, it is used to pick the lights of each draw
+        FrameList<LightInfluence> lightInfluences;
+        // If true, the objects with at least "minQueryTriangles" triangles (or the ones that request it) are drawn using conditional rendering:
+        // their bounding box is drawn (without writing anything) under an occlusion query after the scene, and the next frame draws the object
+        // only if some of the box was visible. The results are never read on the CPU, so it never waits for the GPU
+        bool occlusionQueries = false;
+        int minQueryTriangles = 2000;
+        // The queries are keyed by the entity since the components move in memory when the entities change their archetypes
+        std::unordered_map<const Entity*, OcclusionQuery> queries;
+        // The box drawn as the proxy of a queried object (it is scaled to the bounds of the object)
+        Mesh* proxyBox = nullptr;
+        PipelineState proxyPipelineState;
+        uint64_t frameIndex = 0;
+        // If true, the mesh renderers that have levels of detail are drawn using the level picked by their size on the screen
+        bool levelOfDetail = true;
+        // If true, adjacent opaque commands sharing the same mesh & material are drawn by one instanced draw call
+        // This only applies to the materials that have an instanced shader
+        bool instancing = true;
+        // The minimum number of commands sharing the same mesh & material to draw them as instances
+        int minInstances = 2;
+        // The per-instance data of all the instanced draws in the current frame
+        InstanceBuffer instanceBuffer;
+        // A batch is a range of adjacent entries in "opaqueOrder" that share the same mesh & material
+        // If it is instanced, its instances start at "firstInstance" in the instance buffer
+        struct DrawBatch {
+            uint32_t first, count;
+            uint32_t firstInstance;
+            bool instanced;
+        };
+        FrameList<DrawBatch> opaqueBatches;
+        // If true, the opaque objects are first drawn depth-only, then the color pass draws them using GL_EQUAL depth testing
+        // This way, each pixel is shaded only once no matter how many objects overlap it
+        bool depthPrepass = false;
+        // The shaders used by the depth pre-pass (for normal & instanced draws), the first one also draws the occlusion query proxies
+        ShaderProgram *depthShader = nullptr, *depthInstancedShader = nullptr;
+        // If true, the number of samples shaded by the opaque color pass is counted using occlusion queries
+        // Reading a query result right after drawing would stall the CPU, so we use a ring of queries and read the oldest one
+        bool fragmentStats = false;
+        static constexpr int SAMPLE_QUERY_COUNT = 3;
+        GLuint sampleQueries[SAMPLE_QUERY_COUNT] = {};
+        bool sampleQueryPending[SAMPLE_QUERY_COUNT] = {};
+        int sampleQueryIndex = 0;
+        uint64_t lastShadedSamples = 0;
+        // If true, "onImmediateGui" shows a window with the renderer statistics
+        bool showStats = false;
         LitMaterial* lightMaterial;
+        // If true, the mesh renderers whose bounds are outside the camera frustum will not be drawn
+        bool frustumCulling = true;
+        // The statistics of the last drawn frame
+        RendererStats stats;
+
+        // The ids of the uniforms set by the renderer. They are interned once so that drawing never builds or hashes a uniform name
+        struct RendererUniformIds {
+            UniformId transform = ShaderProgram::intern("transform");
+            UniformId objectToWorld = ShaderProgram::intern("object_to_world");
+            UniformId objectToWorldInvTranspose = ShaderProgram::intern("object_to_world_inv_transpose");
+            UniformId viewProjection = ShaderProgram::intern("view_projection");
+            UniformId cameraPosition = ShaderProgram::intern("camera_position");
+            UniformId objectLightsEnabled = ShaderProgram::intern("object_lights_enabled");
+            UniformId objectLightCount = ShaderProgram::intern("object_light_count");
+            UniformId objectLights = ShaderProgram::intern("object_lights");
+            UniformId texelSize = ShaderProgram::intern("texel_size");
+        } uniforms;
+
+        // The GPU profiler scopes of the render passes (they only measure anything if the profiler is enabled)
+        struct RendererGpuScopes {
+            GpuScopeId depthPrepass = GpuProfiler::registerScope("renderer/depth-prepass");
+            GpuScopeId opaque = GpuProfiler::registerScope("renderer/opaque");
+            GpuScopeId sky = GpuProfiler::registerScope("renderer/sky");
+            GpuScopeId transparent = GpuProfiler::registerScope("renderer/transparent");
+            GpuScopeId upscale = GpuProfiler::registerScope("renderer/upscale");
+            GpuScopeId postprocess = GpuProfiler::registerScope("renderer/postprocess");
+            GpuScopeId occlusionQueries = GpuProfiler::registerScope("renderer/occlusion-queries");
+        } gpuScopes;
+
+        // Holds the per frame data needed while drawing the commands and what was applied by the last drawn command
+        // It is used to skip the parts of the material setup that did not change between adjacent commands
+        struct DrawContext {
+            glm::mat4 VP;
+            glm::vec3 cameraPosition;
+            const Material* material = nullptr;
+            const LitMaterial* litMaterial = nullptr;
+            const ShaderProgram* shader = nullptr;
+            const PipelineState* pipelineState = nullptr;
+            // True if the applied pipeline state was overridden to draw on top of the depth pre-pass (GL_EQUAL with no depth writes)
+            bool equalDepth = false;
+        };
+
+        // Returns the id of the given pipeline state (equal states share the same id)
+        uint32_t getPipelineStateId(const PipelineState& state);
+        // Packs the command state and its normalized depth (0 at the near plane & 1 at the far plane) into a 64-bit sort key
+        uint64_t computeSortKey(const RenderCommand& command, float depth);
+        // Applies the parts of the material setup (using the given program) that differ from the previous draw
+        void applyMaterial(Material* material, ShaderProgram* program, DrawContext& context);
+        // Draws a command after applying its material
+        void drawCommand(const RenderCommand& command, DrawContext& context);
+        // Returns true if the given material is drawn in the depth pre-pass
+        // Only opaque materials that write depth, test depth and don't blend can be drawn depth-only first
+        bool usesDepthPrepass(const Material* material) const;
+        // Draws the depth of all the opaque commands that use the depth pre-pass
+        void drawDepthPrepass(const glm::mat4& VP);
+        // Draws all the commands of an instanced batch by a single draw call using the instanced shader of their material
+        void drawInstancedBatch(const DrawBatch& batch, DrawContext& context);
+        // Gives the command the occlusion query of its object if it should be drawn under one
+        void assignOcclusionQuery(RenderCommand& command);
+        // If the command has a query result from an earlier frame, starts rendering conditionally on it and returns true
+        bool beginConditionalRender(const RenderCommand& command);
+        // Returns true if the command is drawn under a conditional render (its object has a query result from an earlier frame)
+        bool isConditional(const RenderCommand& command) const;
+        // Draws the bounding boxes of the queried commands under their queries (the results are used by the next frame)
+        void drawOcclusionProxies(const glm::mat4& VP, const glm::vec3& cameraPosition, float nearRadius);
+        // Deletes the queries of the objects that were not queried for a while (e.g. the deleted entities)
+        void releaseStaleQueries();
+        // Removes the commands hidden behind the occluders from the given list and returns how many were removed
+        size_t removeOccluded(FrameList<RenderCommand>& commands) const;
+        // Picks the lights that can reach the given sphere and sends their indices to the program (only when object light culling is enabled)
+        void setObjectLights(ShaderProgram* program, const BoundingSphere& sphere);
 
     public:
         // Initialize the renderer including the sky and the Postprocessing objects.
@@ -52,6 +283,11 @@ namespace our
         void destroy();
         // This function should be called every frame to draw the given world
         void render(World* world);
+        // Returns the statistics of the last frame drawn by "render"
+        const RendererStats& getStats() const { return stats; }
+        // Shows the renderer statistics in an ImGui window if "showStats" is enabled in the renderer configuration
+        // It should be called from the "onImmediateGui" of the state
+        void onImmediateGui();
 
 
     };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../mesh/bounds.hpp"
+
+#include <glm/glm.hpp>
+
+namespace our {
+
+    // A view frustum represented by 6 planes (left, right, bottom, top, near, far) in the world space.
+    // Each plane is stored as (a, b, c, d) where a point p is inside the plane if dot(abc, p) + d >= 0
+    struct Frustum {
+        glm::vec4 planes[6];
+
+        // Extracts the frustum planes from a view projection matrix (Gribb & Hartmann method)
+        // Since the input is VP, the planes will be in the world space
+        static Frustum fromMatrix(const glm::mat4& VP){
+            // glm matrices are column major, so we pick the rows manually
+            glm::vec4 row0 = glm::vec4(VP[0][0], VP[1][0], VP[2][0], VP[3][0]);
+            glm::vec4 row1 = glm::vec4(VP[0][1], VP[1][1], VP[2][1], VP[3][1]);
+            glm::vec4 row2 = glm::vec4(VP[0][2], VP[1][2], VP[2][2], VP[3][2]);
+            glm::vec4 row3 = glm::vec4(VP[0][3], VP[1][3], VP[2][3], VP[3][3]);
+
+            Frustum frustum;
+            frustum.planes[0] = row3 + row0; // Left
+            frustum.planes[1] = row3 - row0; // Right
+            frustum.planes[2] = row3 + row1; // Bottom
+            frustum.planes[3] = row3 - row1; // Top
+            frustum.planes[4] = row3 + row2; // Near
+            frustum.planes[5] = row3 - row2; // Far
+            // Normalize the planes so that the distance to a plane is measured in world units (needed for the sphere test)
+            for(auto& plane : frustum.planes) plane /= glm::length(glm::vec3(plane));
+            return frustum;
+        }
+
+        // Returns false if the sphere is completely outside the frustum
+        bool intersects(const BoundingSphere& sphere) const {
+            for(const auto& plane : planes){
+                if(glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) return false;
+            }
+            return true;
+        }
+
+        // Returns false if the box is completely outside the frustum
+        // For each plane, we only test the box corner that is furthest along the plane normal (the positive vertex)
+        bool intersects(const AABB& box) const {
+            for(const auto& plane : planes){
+                glm::vec3 positive = glm::vec3(
+                    plane.x >= 0 ? box.max.x : box.min.x,
+                    plane.y >= 0 ? box.max.y : box.min.y,
+                    plane.z >= 0 ? box.max.z : box.min.z
+                );
+                if(glm::dot(glm::vec3(plane), positive) + plane.w < 0) return false;
+            }
+            return true;
+        }
+    };
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../mesh/mesh.hpp"
+#include "../gl-state-cache.hpp"
+#include "../frame-arena.hpp"
+#include "../matrix-utils.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+namespace our {
+
+    // The data of a single instance as it is read by the instanced shaders
+    struct InstanceData {
+        glm::mat4 localToWorld;
+        // The inverse transpose of the upper 3x3 part of localToWorld (used to transform the normals)
+        glm::mat3 normalMatrix;
+    };
+
+    // This class owns a vertex buffer that holds the per-instance data of all the instanced draws in a frame
+    // The instances are collected on the CPU, uploaded once, then each instanced draw reads its own range of the buffer
+    class InstanceBuffer {
+        GLuint buffer = 0;
+        // The number of instances that the buffer can hold without reallocating
+        size_t capacity = 0;
+        // The instances of the current frame, they are allocated from the frame arena of the renderer
+        FrameList<InstanceData> instances;
+
+    public:
+        void create(){
+            glGenBuffers(1, &buffer);
+        }
+
+        void destroy(){
+            if(buffer) glDeleteBuffers(1, &buffer);
+            buffer = 0;
+            capacity = 0;
+        }
+
+        // Starts collecting the instances of a new frame, "capacity" is the maximum number of instances that could be added this frame
+        void begin(FrameArena& arena, size_t capacity){ instances = arena.allocateList<InstanceData>(capacity); }
+        // The number of instances collected so far, it is also the index that the next added instance will get
+        uint32_t size() const { return (uint32_t)instances.size(); }
+
+        // Adds an instance, the normal matrix is only computed if the shader needs it
+        void add(const glm::mat4& localToWorld, bool computeNormalMatrix){
+            InstanceData& instance = instances.push_back({localToWorld, glm::mat3(1.0f)});
+            if(computeNormalMatrix) instance.normalMatrix = matrix_utils::normalMatrix(localToWorld);
+        }
+
+        // Sends the collected instances to the GPU
+        void upload(){
+            if(instances.empty()) return;
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            // Grow the buffer with some extra space so that it is not reallocated every time a few instances are added
+            if(instances.size() > capacity) capacity = instances.size() + instances.size() / 2;
+            // Reallocating the storage every frame also orphans the old one,
+            // so we don't wait for the GPU to finish reading the instances of the last frame
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        // Attaches the instance attributes to the vertex array of the given mesh so that the first drawn instance is "firstInstance"
+        // Since OpenGL 3.3 has no base instance for draw calls, we move the start of the attributes instead
+        void attachToMesh(Mesh* mesh, uint32_t firstInstance){
+            GLStateCache::bindVertexArray(mesh->getVertexArray());
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            size_t base = firstInstance * sizeof(InstanceData);
+            for(GLuint column = 0; column < 4; column++){
+                GLuint location = ATTRIB_LOC_INSTANCE_TRANSFORM + column;
+                size_t offset = base + offsetof(InstanceData, localToWorld) + column * sizeof(glm::vec4);
+                glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+                glVertexAttribDivisor(location, 1);
+                glEnableVertexAttribArray(location);
+            }
+            for(GLuint column = 0; column < 3; column++){
+                GLuint location = ATTRIB_LOC_INSTANCE_NORMAL + column;
+                size_t offset = base + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3);
+                glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+                glVertexAttribDivisor(location, 1);
+                glEnableVertexAttribArray(location);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    };
+
+}
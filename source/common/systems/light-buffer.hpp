@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../components/light.hpp"
+#include "../shader/shader.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+namespace our {
+
+    // The data of a single light as it is laid out in the "Lights" uniform block (std140 rules)
+    // In std140, a vec3 is aligned to 16 bytes, so we add padding where the next member cannot fill the gap
+    struct LightData {
+        glm::vec3 position;
+        GLint type;
+        glm::vec3 direction;
+        float padding0;
+        glm::vec3 diffuse;
+        float padding1;
+        glm::vec3 specular;
+        float padding2;
+        glm::vec3 attenuation;
+        float padding3;
+        glm::vec2 cone_angles;
+        glm::vec2 padding4;
+    };
+    static_assert(sizeof(LightData) == 96, "LightData must match the std140 layout of the Light struct in the shaders");
+
+    // Reads the world space position & direction of the given light into the layout read by the shaders
+    inline LightData makeLightData(const LightComponent* light){
+        glm::mat4 localToWorld = light->getOwner()->getLocalToWorldMatrix();
+        LightData data;
+        data.type = (GLint)light->type;
+        data.position = glm::vec3(localToWorld[3]);
+        // The light points along its local -Z, since this is a direction we ignore the translation
+        data.direction = glm::normalize(glm::mat3(localToWorld) * glm::vec3(0.0f, 0.0f, -1.0f));
+        data.diffuse = light->diffuse;
+        data.specular = light->specular;
+        data.attenuation = light->attenuation;
+        data.cone_angles = light->cone_angles;
+        return data;
+    }
+
+    // The parameters that the shaders need to find the cluster of a fragment (see LightClusters)
+    // They are stored at the start of the "Lights" block so that they are uploaded with the lights
+    struct ClusterParameters {
+        glm::ivec4 counts;          // xyz: the number of clusters along x, y & z (w is unused)
+        glm::vec4 scale;            // xy: the number of clusters per pixel, z & w: the scale & bias that map log(view depth) to a z slice
+        glm::vec4 cameraForward;    // xyz: the camera forward direction in the world space (w is unused)
+    };
+
+    // This class owns the uniform buffer that holds the lights of the scene.
+    // The lights are gathered and uploaded once per frame, then every program that declares the "Lights" block
+    // reads them from the same buffer (so nothing light related is sent per draw)
+    class LightBuffer {
+    public:
+        // This must match MAX_LIGHTS in the shaders
+        // The block of 128 lights takes about 12KB which fits in the minimum uniform block size (16KB) that OpenGL guarantees
+        static constexpr int MAX_LIGHTS = 128;
+
+    private:
+        // The CPU copy of the block. The light count comes first so that we only upload the part of the array that is used
+        // If "clustered" is true, the block only holds the lights that reach everything (e.g. directional lights)
+        // and the rest of the lights are read from the clusters of each fragment
+        struct Block {
+            GLint count;
+            GLint clustered;
+            GLint padding[2];
+            ClusterParameters clusters;
+            LightData lights[MAX_LIGHTS];
+        } block = {};
+
+        GLuint buffer = 0;
+
+    public:
+        // The number of lights in the block and their data (as uploaded by the last update)
+        int getCount() const { return block.count; }
+        const LightData& getLight(int index) const { return block.lights[index]; }
+
+        // Creates the uniform buffer and binds it to the binding point of the "Lights" block
+        void create(){
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            glBindBufferBase(GL_UNIFORM_BUFFER, uniform_blocks::LIGHTS, buffer);
+        }
+
+        void destroy(){
+            if(buffer) glDeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+
+        // Reads the world space position & direction of every light and uploads them to the uniform buffer
+        // Lights beyond MAX_LIGHTS are ignored. If "clusters" is not null, the shaders will also read the lights of the clusters
+        void update(LightComponent* const* lights, size_t lightCount, const ClusterParameters* clusters = nullptr){
+            int count = glm::min((int)lightCount, MAX_LIGHTS);
+            block.count = count;
+            block.clustered = clusters != nullptr;
+            if(clusters) block.clusters = *clusters;
+            for(int i = 0; i < count; i++) block.lights[i] = makeLightData(lights[i]);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, offsetof(Block, lights) + count * sizeof(LightData), &block);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            // Rebind it in case something else used the binding point (this is cheap compared to the per draw uploads it replaces)
+            glBindBufferBase(GL_UNIFORM_BUFFER, uniform_blocks::LIGHTS, buffer);
+        }
+    };
+
+}
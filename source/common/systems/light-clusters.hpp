@@ -0,0 +1,220 @@
+#pragma once
+
+#include "light-buffer.hpp"
+#include "light-selection.hpp"
+#include "../gl-state-cache.hpp"
+#include "../worker-pool.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace our {
+
+    // Clustered light assignment: the view frustum is split into a 3D grid of clusters (tiles on the screen x slices along the depth)
+    // and every frame, each light is added to the list of the clusters that its sphere of influence overlaps.
+    // While shading, a fragment finds its cluster from its screen position & view depth and only evaluates the lights in that cluster,
+    // so the cost of a fragment depends on the lights near it instead of all the lights in the scene.
+    // The depth slices grow exponentially with the distance, so the clusters near the camera (where the lights cover more pixels) are thinner.
+    // The lights, the light lists and the cluster table are sent to the shaders using texture buffers (which have no size limit unlike uniform buffers)
+    class LightClusters {
+    public:
+        // If there are fewer lights than this, the clusters are filled on the calling thread only (waking the workers costs more than the work)
+        static constexpr size_t MIN_LIGHTS_FOR_THREADS = 64;
+
+    private:
+        // A buffer whose content is read in the shaders as a texture (using texelFetch)
+        struct TextureBuffer {
+            GLuint buffer = 0, texture = 0;
+            size_t capacity = 0; // In bytes
+
+            void create(GLenum format){
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+                capacity = 256;
+                glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+                glBindBuffer(GL_TEXTURE_BUFFER, 0);
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_BUFFER, texture);
+                glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+                glBindTexture(GL_TEXTURE_BUFFER, 0);
+            }
+
+            void destroy(){
+                if(texture) glDeleteTextures(1, &texture);
+                if(buffer) glDeleteBuffers(1, &buffer);
+                texture = buffer = 0;
+                capacity = 0;
+            }
+
+            void upload(const void* data, size_t size){
+                glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+                // Grow the buffer with some extra space so that it is not reallocated every time a few lights are added
+                if(size > capacity) capacity = size + size / 2;
+                // Reallocating the storage every frame also orphans the old one, so we don't wait for the GPU to finish the last frame
+                glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+                if(size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+                glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            }
+
+            void bind(GLuint unit){
+                // The state cache only tracks the GL_TEXTURE_2D bindings, so binding to GL_TEXTURE_BUFFER doesn't affect it
+                GLStateCache::activeTexture(unit);
+                glBindTexture(GL_TEXTURE_BUFFER, texture);
+            }
+        };
+
+        // The range of clusters overlapped by a light (inclusive). If min is greater than max, the light is not visible
+        struct LightBounds {
+            glm::ivec3 min, max;
+        };
+
+        glm::ivec3 counts = {16, 9, 24};
+        ClusterParameters parameters = {};
+        // For every cluster, the offset of its first light index (x) and its light count (y)
+        std::vector<glm::uvec2> table;
+        std::vector<LightData> lightData;
+        std::vector<LightBounds> bounds;
+        std::vector<uint32_t> indices;
+        // Each worker fills the clusters of a range of depth slices, writing the light indices into its own list
+        // "sliceLights" holds the lights overlapping the slice that a worker is filling
+        std::vector<std::vector<uint32_t>> workerIndices, sliceLights;
+        TextureBuffer tableBuffer, indexBuffer, lightBuffer;
+
+        // Returns the depth slice that contains the given view depth
+        int getSlice(float depth, float near, float far) const {
+            if(depth <= near) return 0;
+            int slice = (int)std::floor(std::log(depth / near) / std::log(far / near) * counts.z);
+            return glm::clamp(slice, 0, counts.z - 1);
+        }
+
+        // Finds the clusters overlapped by a sphere in the view space
+        LightBounds computeBounds(const glm::vec3& center, float radius, const glm::mat4& P, float near, float far) const {
+            LightBounds empty = {glm::ivec3(0), glm::ivec3(-1)};
+            float depth = -center.z;
+            float minDepth = depth - radius, maxDepth = depth + radius;
+            if(maxDepth < near || minDepth > far) return empty;
+            LightBounds result = {glm::ivec3(0, 0, getSlice(minDepth, near, far)), glm::ivec3(counts.x - 1, counts.y - 1, getSlice(maxDepth, near, far))};
+            // If the sphere crosses the near plane, its projection could cover any part of the screen so we keep all the tiles
+            if(minDepth <= near) return result;
+            // Otherwise, we project the corners of the box around the sphere and pick the tiles covered by their screen space bounds
+            glm::vec2 ndcMin(std::numeric_limits<float>::max()), ndcMax(-std::numeric_limits<float>::max());
+            for(int corner = 0; corner < 8; corner++){
+                glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+                glm::vec4 clip = P * glm::vec4(center + offset, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+            if(ndcMax.x < -1 || ndcMax.y < -1 || ndcMin.x > 1 || ndcMin.y > 1) return empty;
+            glm::ivec2 lastTile(counts.x - 1, counts.y - 1);
+            glm::ivec2 minTile = glm::clamp(glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * glm::vec2(counts))), glm::ivec2(0), lastTile);
+            glm::ivec2 maxTile = glm::clamp(glm::ivec2(glm::floor((ndcMax * 0.5f + 0.5f) * glm::vec2(counts))), glm::ivec2(0), lastTile);
+            result.min.x = minTile.x; result.min.y = minTile.y;
+            result.max.x = maxTile.x; result.max.y = maxTile.y;
+            return result;
+        }
+
+    public:
+        // Creates the texture buffers, "counts" is the number of clusters along x, y & z
+        void create(glm::ivec3 counts){
+            this->counts = glm::max(counts, glm::ivec3(1));
+            table.resize((size_t)this->counts.x * this->counts.y * this->counts.z);
+            tableBuffer.create(GL_RG32UI);
+            indexBuffer.create(GL_R32UI);
+            lightBuffer.create(GL_RGBA32F);
+        }
+
+        void destroy(){
+            tableBuffer.destroy();
+            indexBuffer.destroy();
+            lightBuffer.destroy();
+        }
+
+        // Assigns the given lights (which must have a finite range, see "computeLightRange") to the clusters of the given camera then uploads the clusters to the GPU
+        // "viewportSize" is the size of the framebuffer in pixels (it is needed to find the tile of a fragment from gl_FragCoord)
+        void update(LightComponent* const* lights, size_t lightCount, const glm::mat4& V, const glm::mat4& P, float near, float far,
+                    glm::ivec2 viewportSize, const glm::vec3& cameraForward, WorkerPool* pool){
+            lightData.clear();
+            bounds.clear();
+            for(size_t i = 0; i < lightCount; i++){
+                LightData data = makeLightData(lights[i]);
+                glm::vec3 center = glm::vec3(V * glm::vec4(data.position, 1.0f));
+                lightData.push_back(data);
+                bounds.push_back(computeBounds(center, computeLightRange(lights[i]), P, near, far));
+            }
+
+            // Fill the clusters of a range of depth slices. The ranges don't overlap so each cluster is written by one worker only
+            bool parallel = pool && lightCount >= MIN_LIGHTS_FOR_THREADS;
+            size_t workerCount = parallel ? pool->getWorkerCount() : 1;
+            if(workerIndices.size() < workerCount){
+                workerIndices.resize(workerCount);
+                sliceLights.resize(workerCount);
+            }
+            auto assign = [&](size_t begin, size_t end, size_t worker){
+                std::vector<uint32_t>& output = workerIndices[worker];
+                std::vector<uint32_t>& candidates = sliceLights[worker];
+                output.clear();
+                for(int z = (int)begin; z < (int)end; z++){
+                    candidates.clear();
+                    for(uint32_t light = 0; light < (uint32_t)bounds.size(); light++){
+                        if(bounds[light].min.z <= z && z <= bounds[light].max.z) candidates.push_back(light);
+                    }
+                    for(int y = 0; y < counts.y; y++){
+                        for(int x = 0; x < counts.x; x++){
+                            size_t cluster = x + (size_t)counts.x * (y + (size_t)counts.y * z);
+                            uint32_t first = (uint32_t)output.size();
+                            for(uint32_t light : candidates){
+                                const LightBounds& lightBounds = bounds[light];
+                                if(lightBounds.min.x <= x && x <= lightBounds.max.x && lightBounds.min.y <= y && y <= lightBounds.max.y)
+                                    output.push_back(light);
+                            }
+                            // The offset is relative to the list of this worker for now, it is fixed when the lists are merged
+                            table[cluster] = glm::uvec2(first, (uint32_t)output.size() - first);
+                        }
+                    }
+                }
+            };
+            size_t sliceRange = counts.z;
+            if(parallel){
+                sliceRange = pool->getRangeSize(counts.z, 1);
+                pool->parallelFor(counts.z, 1, assign);
+            } else {
+                assign(0, counts.z, 0);
+            }
+
+            // Merge the lists of the workers in order and move the offsets of their clusters to the merged list
+            indices.clear();
+            size_t clustersPerSlice = (size_t)counts.x * counts.y;
+            for(size_t worker = 0; worker * sliceRange < (size_t)counts.z; worker++){
+                uint32_t base = (uint32_t)indices.size();
+                size_t firstCluster = worker * sliceRange * clustersPerSlice;
+                size_t lastCluster = glm::min((worker + 1) * sliceRange, (size_t)counts.z) * clustersPerSlice;
+                for(size_t cluster = firstCluster; cluster < lastCluster; cluster++) table[cluster].x += base;
+                indices.insert(indices.end(), workerIndices[worker].begin(), workerIndices[worker].end());
+            }
+
+            tableBuffer.upload(table.data(), table.size() * sizeof(glm::uvec2));
+            indexBuffer.upload(indices.data(), indices.size() * sizeof(uint32_t));
+            lightBuffer.upload(lightData.data(), lightData.size() * sizeof(LightData));
+            tableBuffer.bind(texture_units::CLUSTER_TABLE);
+            indexBuffer.bind(texture_units::CLUSTER_INDICES);
+            lightBuffer.bind(texture_units::CLUSTER_LIGHTS);
+
+            // The shader finds the slice using log(depth) * scale + bias which is the same as "getSlice"
+            float depthScale = counts.z / std::log(far / near);
+            parameters.counts = glm::ivec4(counts, 0);
+            parameters.scale = glm::vec4(glm::vec2(counts.x, counts.y) / glm::vec2(viewportSize), depthScale, -std::log(near) * depthScale);
+            parameters.cameraForward = glm::vec4(cameraForward, 0.0f);
+        }
+
+        // The parameters that should be given to LightBuffer::update so that the shaders can find the cluster of each fragment
+        const ClusterParameters& getParameters() const { return parameters; }
+        // The number of light indices stored in all the clusters (a light is counted once for every cluster it overlaps)
+        size_t getIndexCount() const { return indices.size(); }
+    };
+
+}
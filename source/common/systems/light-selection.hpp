@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../components/light.hpp"
+#include "../mesh/bounds.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace our {
+
+    // Returns the distance at which the attenuation of the light makes it 256 times darker than its brightest channel (so it cannot be seen anymore)
+    // Returns infinity if the light never fades out (directional lights & lights without distance attenuation)
+    inline float computeLightRange(const LightComponent* light){
+        if(light->type == LightType::DIRECTIONAL) return std::numeric_limits<float>::infinity();
+        glm::vec3 brightness = glm::max(light->diffuse, light->specular);
+        float threshold = 256.0f * glm::max(1.0f, glm::max(brightness.x, glm::max(brightness.y, brightness.z)));
+        // The attenuation is 1 / (constant + linear * d + quadratic * d^2), so we solve for the distance where the denominator equals the threshold
+        float constant = light->attenuation.x, linear = light->attenuation.y, quadratic = light->attenuation.z;
+        if(constant >= threshold) return 0.0f;
+        if(quadratic > 0) return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * (threshold - constant))) / (2.0f * quadratic);
+        if(linear > 0) return (threshold - constant) / linear;
+        return std::numeric_limits<float>::infinity();
+    }
+
+    // The data needed to decide whether a light can reach an object and to estimate how much it contributes to it
+    // It is computed once per frame for every light in the "Lights" uniform block
+    struct LightInfluence {
+        LightType type;
+        glm::vec3 position;
+        glm::vec3 direction;
+        glm::vec3 attenuation;
+        float range;
+        float brightness;   // The brightest channel of the diffuse & specular colors
+        // The sine & cosine of the outer cone angle (only used for spot lights whose cone is narrower than a half sphere)
+        float cosOuterAngle, sinOuterAngle;
+        bool cone;
+
+        // "position" & "direction" are the world space values of the light (as they were sent to the uniform block)
+        static LightInfluence make(const LightComponent* light, const glm::vec3& position, const glm::vec3& direction){
+            LightInfluence influence;
+            influence.type = light->type;
+            influence.position = position;
+            influence.direction = direction;
+            influence.attenuation = light->attenuation;
+            influence.range = computeLightRange(light);
+            glm::vec3 brightness = glm::max(light->diffuse, light->specular);
+            influence.brightness = glm::max(brightness.x, glm::max(brightness.y, brightness.z));
+            float outerAngle = light->cone_angles.y;
+            influence.cone = light->type == LightType::SPOT && outerAngle < glm::half_pi<float>();
+            influence.cosOuterAngle = std::cos(outerAngle);
+            influence.sinOuterAngle = std::sin(outerAngle);
+            return influence;
+        }
+
+        // Returns an estimate of how much this light could light an object inside the given sphere (0 if the light cannot reach it)
+        // The estimate is the brightness of the light attenuated by the distance to the closest point of the sphere
+        float estimateContribution(const BoundingSphere& sphere) const {
+            if(type == LightType::DIRECTIONAL) return brightness;
+            glm::vec3 toCenter = sphere.center - position;
+            float distance = glm::length(toCenter);
+            if(distance - sphere.radius > range) return 0.0f;
+            if(cone){
+                // Sphere vs cone test: find the distance from the sphere center to the cone surface
+                float along = glm::dot(toCenter, direction);
+                float across = std::sqrt(glm::max(0.0f, distance * distance - along * along));
+                float distanceToCone = cosOuterAngle * across - sinOuterAngle * along;
+                if(distanceToCone > sphere.radius || along < -sphere.radius) return 0.0f;
+            }
+            float closest = glm::max(0.0f, distance - sphere.radius);
+            float denominator = attenuation.x + attenuation.y * closest + attenuation.z * closest * closest;
+            return brightness / glm::max(denominator, 1e-3f);
+        }
+    };
+
+    // A fixed size list of the lights that affect a single draw. The list holds the indices of the lights in the "Lights" uniform block
+    // ordered from the strongest to the weakest, so if more lights reach the object, only the strongest ones are kept
+    struct ObjectLights {
+        // This must match MAX_OBJECT_LIGHTS in the shaders
+        static constexpr int MAX_LIGHTS = 8;
+        GLint count = 0;
+        GLint indices[MAX_LIGHTS];
+        float contributions[MAX_LIGHTS];
+
+        // Picks the strongest lights (out of the given lights) that can reach an object inside the given sphere
+        void select(const LightInfluence* lights, size_t lightCount, const BoundingSphere& sphere){
+            count = 0;
+            for(size_t light = 0; light < lightCount; light++){
+                float contribution = lights[light].estimateContribution(sphere);
+                if(contribution <= 0.0f) continue;
+                if(count == MAX_LIGHTS && contribution <= contributions[MAX_LIGHTS - 1]) continue;
+                // Insert the light in order (the weakest light is dropped if the list is full)
+                int position = count < MAX_LIGHTS ? count++ : MAX_LIGHTS - 1;
+                while(position > 0 && contributions[position - 1] < contribution){
+                    indices[position] = indices[position - 1];
+                    contributions[position] = contributions[position - 1];
+                    position--;
+                }
+                indices[position] = (GLint)light;
+                contributions[position] = contribution;
+            }
+        }
+    };
+
+}
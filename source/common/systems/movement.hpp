@@ -19,17 +19,12 @@ namespace our
 
         // This should be called every frame to update all entities containing a MovementComponent. 
         void update(World* world, float deltaTime) {
-            // For each entity in the world
-            for(auto entity : world->getEntities()){
-                // Get the movement component if it exists
-                MovementComponent* movement = entity->getComponent<MovementComponent>();
-                // If the movement component exists
-                if(movement){
-                    // Change the position and rotation based on the linear & angular velocity and delta time.
-                    entity->localTransform.position += deltaTime * movement->linearVelocity;
-                    entity->localTransform.rotation += deltaTime * movement->angularVelocity;
-                }
-            }
+            // For each entity that has a movement component (the view skips all the other entities)
+            world->view<MovementComponent>().each([deltaTime](Entity* entity, MovementComponent& movement){
+                // Change the position and rotation based on the linear & angular velocity and delta time.
+                entity->localTransform.position += deltaTime * movement.linearVelocity;
+                entity->localTransform.rotation += deltaTime * movement.angularVelocity;
+            });
         }
 
     };
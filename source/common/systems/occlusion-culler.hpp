@@ -0,0 +1,223 @@
+#pragma once
+
+#include "../mesh/bounds.hpp"
+#include "../worker-pool.hpp"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// The rasterizer processes 4 pixels at once using SSE2 when it is available (it is always available on x86-64)
+// Otherwise, it falls back to processing one pixel at a time
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OUR_OCCLUSION_SSE2 1
+#endif
+
+namespace our {
+
+    // Software occlusion culling: a few objects marked as occluders (usually big & simple like walls or buildings) are rasterized on the CPU
+    // into a low resolution depth buffer, then the screen space bounds of every other object are tested against it.
+    // If the nearest point of an object's box is behind the depth of every pixel covered by the box, the object is hidden so it is not drawn.
+    // Everything runs on the CPU (no OpenGL calls), so the culling decision is known before any draw call is issued.
+    // The depth is the NDC z which (unlike the view depth) varies linearly on the screen, so it can be interpolated across a triangle as a plane.
+    // A pixel is covered by a triangle if its center is inside the triangle (like the GPU does). Since the buffer is small,
+    // an object could be hidden even if a sliver of it (thinner than half a buffer pixel) is visible along the edge of an occluder
+    class OcclusionCuller {
+    public:
+        // The rows of the buffer are split into bands of this height, and each worker rasterizes all the triangles into a range of bands
+        static constexpr int BAND_ROWS = 8;
+        // If there are fewer triangles than this, they are rasterized on the calling thread only (waking the workers costs more than the work)
+        static constexpr size_t MIN_TRIANGLES_FOR_THREADS = 64;
+
+    private:
+        // A triangle after projecting it to the buffer, set up for testing the pixels
+        // The values are evaluated at the integer pixel coordinates (the half pixel offset to the pixel center is folded into the constants)
+        struct ScreenTriangle {
+            // A pixel is inside the triangle if a * x + b * y + c >= 0 for all the 3 edges
+            float edgeA[3], edgeB[3], edgeC[3];
+            // The depth of the triangle in a pixel is depthX * x + depthY * y + depthC, but not farther than "maxDepth"
+            // The plane is pushed back by half a pixel along both axes so that the value is the farthest depth of the triangle inside the pixel
+            float depthX, depthY, depthC, maxDepth;
+            // The range of pixels covered by the bounds of the triangle (inclusive)
+            int minX, maxX, minY, maxY;
+        };
+
+        // The width is always a multiple of 4 so that a row can be processed 4 pixels at a time
+        glm::ivec2 size = {256, 128};
+        // The nearest occluder depth in every pixel (1 is the far plane)
+        std::vector<float> depth;
+        std::vector<ScreenTriangle> triangles;
+        // The clip space positions of the vertices of the occluder being added
+        std::vector<glm::vec4> clipPositions;
+        glm::mat4 VP = glm::mat4(1.0f);
+        size_t occluderCount = 0;
+
+        // Sets up a triangle given the clip space positions of its vertices and adds it to the list
+        void addTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2){
+            // Triangles crossing the near plane would need clipping. Skipping them is safe since an occluder can only hide less without them
+            if(c0.w <= 0 || c1.w <= 0 || c2.w <= 0 || c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w) return;
+            glm::vec2 halfSize = glm::vec2(size) * 0.5f;
+            glm::vec3 p[3];
+            const glm::vec4* clip[3] = {&c0, &c1, &c2};
+            for(int i = 0; i < 3; i++){
+                float inverseW = 1.0f / clip[i]->w;
+                p[i] = glm::vec3((clip[i]->x * inverseW + 1.0f) * halfSize.x, (clip[i]->y * inverseW + 1.0f) * halfSize.y, clip[i]->z * inverseW);
+            }
+            float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+            if(std::abs(area) < 1e-8f) return;
+
+            // Find the pixels whose centers are inside the bounds of the triangle (x + 0.5 >= min.x and x + 0.5 <= max.x)
+            ScreenTriangle triangle;
+            glm::vec2 min = glm::min(glm::vec2(p[0]), glm::min(glm::vec2(p[1]), glm::vec2(p[2])));
+            glm::vec2 max = glm::max(glm::vec2(p[0]), glm::max(glm::vec2(p[1]), glm::vec2(p[2])));
+            triangle.minX = std::max(0, (int)std::ceil(min.x - 0.5f));
+            triangle.minY = std::max(0, (int)std::ceil(min.y - 0.5f));
+            triangle.maxX = std::min(size.x - 1, (int)std::floor(max.x - 0.5f));
+            triangle.maxY = std::min(size.y - 1, (int)std::floor(max.y - 0.5f));
+            if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+
+            // Both windings are rasterized (the back faces of a closed occluder are behind its front faces anyway),
+            // so the edges are flipped for clockwise triangles to keep the inside positive
+            float sign = area > 0 ? 1.0f : -1.0f;
+            for(int i = 0; i < 3; i++){
+                const glm::vec3& from = p[i];
+                const glm::vec3& to = p[(i + 1) % 3];
+                float a = sign * (from.y - to.y), b = sign * (to.x - from.x);
+                triangle.edgeA[i] = a;
+                triangle.edgeB[i] = b;
+                triangle.edgeC[i] = -(a * from.x + b * from.y) + 0.5f * (a + b);
+            }
+            // Solve for the plane that passes through the depths of the 3 vertices
+            float depthX = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+            float depthY = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+            triangle.depthX = depthX;
+            triangle.depthY = depthY;
+            triangle.depthC = p[0].z - depthX * p[0].x - depthY * p[0].y + 0.5f * (depthX + depthY) + 0.5f * (std::abs(depthX) + std::abs(depthY));
+            triangle.maxDepth = std::max(p[0].z, std::max(p[1].z, p[2].z));
+            triangles.push_back(triangle);
+        }
+
+        // Rasterizes all the triangles into the rows [firstRow, lastRow)
+        void rasterizeBand(int firstRow, int lastRow){
+            for(const ScreenTriangle& triangle : triangles){
+                int minY = std::max(triangle.minY, firstRow), maxY = std::min(triangle.maxY, lastRow - 1);
+#if defined(OUR_OCCLUSION_SSE2)
+                // Start at a multiple of 4 so that the loads & stores are aligned to the groups of 4 pixels (the extra pixels fail the edge tests)
+                int minX = triangle.minX & ~3;
+                __m128 edgeA[3], rowTerm[3];
+                for(int i = 0; i < 3; i++) edgeA[i] = _mm_set1_ps(triangle.edgeA[i]);
+                __m128 depthX = _mm_set1_ps(triangle.depthX), maxDepth = _mm_set1_ps(triangle.maxDepth);
+                __m128 zero = _mm_setzero_ps();
+                for(int y = minY; y <= maxY; y++){
+                    for(int i = 0; i < 3; i++) rowTerm[i] = _mm_set1_ps(triangle.edgeB[i] * y + triangle.edgeC[i]);
+                    __m128 depthRow = _mm_set1_ps(triangle.depthY * y + triangle.depthC);
+                    float* row = depth.data() + (size_t)y * size.x;
+                    for(int x = minX; x <= triangle.maxX; x += 4){
+                        __m128 xs = _mm_set_ps((float)(x + 3), (float)(x + 2), (float)(x + 1), (float)x);
+                        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], xs), rowTerm[0]), zero);
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], xs), rowTerm[1]), zero));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], xs), rowTerm[2]), zero));
+                        if(_mm_movemask_ps(inside) == 0) continue;
+                        __m128 triangleDepth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(depthX, xs), depthRow), maxDepth);
+                        __m128 old = _mm_loadu_ps(row + x);
+                        __m128 nearest = _mm_min_ps(old, triangleDepth);
+                        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+                    }
+                }
+#else
+                for(int y = minY; y <= maxY; y++){
+                    float* row = depth.data() + (size_t)y * size.x;
+                    for(int x = triangle.minX; x <= triangle.maxX; x++){
+                        bool inside = true;
+                        for(int i = 0; i < 3; i++) inside = inside && triangle.edgeA[i] * x + triangle.edgeB[i] * y + triangle.edgeC[i] >= 0;
+                        if(!inside) continue;
+                        float triangleDepth = std::min(triangle.depthX * x + triangle.depthY * y + triangle.depthC, triangle.maxDepth);
+                        row[x] = std::min(row[x], triangleDepth);
+                    }
+                }
+#endif
+            }
+        }
+
+    public:
+        // Allocates the depth buffer with the given resolution (the width is rounded up to a multiple of 4)
+        void create(glm::ivec2 size){
+            this->size = glm::max(size, glm::ivec2(4, 1));
+            this->size.x = (this->size.x + 3) & ~3;
+            depth.assign((size_t)this->size.x * this->size.y, 1.0f);
+        }
+
+        // Starts a new frame: clears the occluders & the depth buffer. "VP" is the view projection matrix of the camera
+        void begin(const glm::mat4& VP){
+            this->VP = VP;
+            std::fill(depth.begin(), depth.end(), 1.0f);
+            triangles.clear();
+            occluderCount = 0;
+        }
+
+        // Adds the triangles of an occluder mesh (given by its vertex positions & elements) placed at the given transformation
+        void addOccluder(const glm::vec3* positions, size_t positionCount, const unsigned int* elements, size_t elementCount, const glm::mat4& localToWorld){
+            glm::mat4 MVP = VP * localToWorld;
+            clipPositions.resize(positionCount);
+            for(size_t i = 0; i < positionCount; i++) clipPositions[i] = MVP * glm::vec4(positions[i], 1.0f);
+            for(size_t i = 0; i + 2 < elementCount; i += 3){
+                addTriangle(clipPositions[elements[i]], clipPositions[elements[i + 1]], clipPositions[elements[i + 2]]);
+            }
+            occluderCount++;
+        }
+
+        // Rasterizes all the added occluders. The bands don't overlap so each pixel is written by one worker only
+        void rasterize(WorkerPool* pool){
+            if(triangles.empty()) return;
+            size_t bandCount = (size.y + BAND_ROWS - 1) / BAND_ROWS;
+            auto rasterizeBands = [&](size_t begin, size_t end, size_t){
+                for(size_t band = begin; band < end; band++){
+                    rasterizeBand((int)band * BAND_ROWS, std::min((int)(band + 1) * BAND_ROWS, size.y));
+                }
+            };
+            if(pool && triangles.size() >= MIN_TRIANGLES_FOR_THREADS) pool->parallelFor(bandCount, 1, rasterizeBands);
+            else rasterizeBands(0, bandCount, 0);
+        }
+
+        // Returns false if the given box (in the world space) is hidden behind the rasterized occluders
+        // It is safe to call from multiple threads after "rasterize" returns
+        bool isVisible(const AABB& box) const {
+            glm::vec2 min(size), max(0.0f);
+            float nearest = 1.0f;
+            glm::vec2 halfSize = glm::vec2(size) * 0.5f;
+            for(int corner = 0; corner < 8; corner++){
+                glm::vec3 position((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+                glm::vec4 clip = VP * glm::vec4(position, 1.0f);
+                // If the box crosses the near plane, its projection could cover any part of the screen so we consider it visible
+                if(clip.w <= 0 || clip.z < -clip.w) return true;
+                glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                glm::vec2 screen = (glm::vec2(ndc) + 1.0f) * halfSize;
+                min = glm::min(min, screen);
+                max = glm::max(max, screen);
+                nearest = std::min(nearest, ndc.z);
+            }
+            // Test every pixel that the rectangle touches (even partially), the box is visible if any of them has no occluder in front of the box
+            int minX = std::max(0, (int)std::floor(min.x)), minY = std::max(0, (int)std::floor(min.y));
+            int maxX = std::min(size.x - 1, (int)std::ceil(max.x) - 1), maxY = std::min(size.y - 1, (int)std::ceil(max.y) - 1);
+            if(minX > maxX || minY > maxY) return true;
+            for(int y = minY; y <= maxY; y++){
+                const float* row = depth.data() + (size_t)y * size.x;
+                for(int x = minX; x <= maxX; x++){
+                    if(row[x] >= nearest) return true;
+                }
+            }
+            return false;
+        }
+
+        glm::ivec2 getSize() const { return size; }
+        // The nearest occluder depth (in NDC) at the given pixel
+        float getDepth(int x, int y) const { return depth[(size_t)y * size.x + x]; }
+        // The number of occluders & triangles added in the current frame (the triangles crossing the near plane or covering no pixels are not counted)
+        size_t getOccluderCount() const { return occluderCount; }
+        size_t getTriangleCount() const { return triangles.size(); }
+    };
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace our {
+
+    // A sort entry pairs a 64-bit sort key with the index of the item it was computed for.
+    // Sorting these small entries is much cheaper than moving the items themselves around.
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // Converts a float to an unsigned integer that has the same order (so floats can be used in sort keys)
+    // Positive floats only need their sign bit set, while negative floats need all their bits flipped
+    inline uint32_t floatToSortableBits(float value){
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+
+    // Sorts the entries in ascending order of their keys using a least significant digit radix sort (8 bits per pass).
+    // The sort is stable so entries with equal keys keep their relative order.
+    // "scratch" is a temporary buffer that can hold "count" entries. It is passed by the caller so that no memory is allocated while sorting.
+    inline void radixSort(SortEntry* entries, SortEntry* scratch, size_t count){
+        if(count < 2) return;
+
+        SortEntry* source = entries;
+        SortEntry* destination = scratch;
+
+        for(int shift = 0; shift < 64; shift += 8){
+            size_t offsets[256];
+            std::memset(offsets, 0, sizeof(offsets));
+            for(size_t i = 0; i < count; i++) offsets[(source[i].key >> shift) & 0xFF]++;
+
+            // If all the keys share the same digit, this pass would not change anything so we skip it
+            // This is common for the high bits since the keys rarely use the whole 64-bit range
+            if(offsets[(source[0].key >> shift) & 0xFF] == count) continue;
+
+            // Convert the histogram into the starting offset of each digit
+            size_t sum = 0;
+            for(auto& offset : offsets){
+                size_t digitCount = offset;
+                offset = sum;
+                sum += digitCount;
+            }
+            for(size_t i = 0; i < count; i++) destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+            std::swap(source, destination);
+        }
+
+        // If the last pass wrote to the scratch buffer, we copy the result back
+        if(source != entries) std::memcpy(entries, source, count * sizeof(SortEntry));
+    }
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../texture/texture2d.hpp"
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+namespace our {
+
+    // A framebuffer with a color texture and an optional depth texture
+    // The textures only have one mip level since they are always sampled at the size they were drawn at (no mipmaps are generated)
+    struct RenderTarget {
+        GLuint framebuffer = 0;
+        Texture2D* color = nullptr;
+        Texture2D* depth = nullptr;
+        glm::ivec2 size = glm::ivec2(0);
+
+        void create(glm::ivec2 size, bool withDepth){
+            this->size = size;
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+            color = new Texture2D();
+            color->bind();
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, size.x, size.y);
+            glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color->getOpenGLName(), 0);
+            if(withDepth){
+                depth = new Texture2D();
+                depth->bind();
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size.x, size.y);
+                glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth->getOpenGLName(), 0);
+            }
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        }
+
+        void destroy(){
+            if(framebuffer) glDeleteFramebuffers(1, &framebuffer);
+            framebuffer = 0;
+            delete color;
+            delete depth;
+            color = depth = nullptr;
+        }
+
+        // Binds the framebuffer for drawing and sets the viewport to cover all of it
+        void bind() const {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, size.x, size.y);
+        }
+    };
+
+    // A pool of color targets shared by the postprocess passes
+    // A pass cannot draw to the target it reads from, so a chain of passes with the same size alternates (ping-pongs) between two targets
+    class RenderTargetPool {
+        std::vector<std::unique_ptr<RenderTarget>> targets;
+    public:
+        // Returns a target with the given size that is not "input" (the target that the pass reads from)
+        // An existing target is reused if possible, otherwise a new one is created
+        RenderTarget* acquire(glm::ivec2 size, const RenderTarget* input){
+            for(auto& target : targets){
+                if(target->size == size && target.get() != input) return target.get();
+            }
+            targets.push_back(std::make_unique<RenderTarget>());
+            targets.back()->create(size, false);
+            return targets.back().get();
+        }
+
+        // The number of targets created by the pool
+        size_t size() const { return targets.size(); }
+
+        void destroy(){
+            for(auto& target : targets) target->destroy();
+            targets.clear();
+        }
+    };
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glad/gl.h>
+#include "../gl-state-cache.hpp"
 
 namespace our {
 
@@ -18,6 +19,7 @@ namespace our {
         // This deconstructor deletes the underlying OpenGL texture
         ~Texture2D() { 
             //TODO: (Req 5) Complete this function
+            GLStateCache::forgetTexture(name);
             glDeleteTextures(1, &name);
         }
 
@@ -29,13 +31,13 @@ namespace our {
         // This method binds this texture to GL_TEXTURE_2D
         void bind() const {
             //TODO: (Req 5) Complete this function
-            glBindTexture(GL_TEXTURE_2D, name);
+            GLStateCache::bindTexture(name);
         }
 
         // This static method ensures that no texture is bound to GL_TEXTURE_2D
         static void unbind(){
             //TODO: (Req 5) Complete this function
-            glBindTexture(GL_TEXTURE_2D, 0);
+            GLStateCache::bindTexture(0);
         }
 
         Texture2D(const Texture2D&) = delete;
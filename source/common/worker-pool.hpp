@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace our {
+
+    // A pool of worker threads that are created once and reused to run data parallel loops (see "parallelFor")
+    // The calling thread also works on the loop, so a pool with N workers uses N threads including the caller
+    class WorkerPool {
+        std::vector<std::thread> threads;
+        std::mutex mutex;
+        std::condition_variable startCondition, doneCondition;
+        // The current loop. "generation" is increased whenever a new loop starts so that the workers know that they have new work
+        // The function of the loop is stored as a pointer to the callable and a function that invokes it (instead of a std::function)
+        // so starting a loop never allocates memory
+        const void* function = nullptr;
+        void (*invoke)(const void* function, size_t begin, size_t end, size_t worker) = nullptr;
+        size_t itemCount = 0, rangeSize = 0;
+        uint64_t generation = 0;
+        size_t pendingWorkers = 0;
+        bool stopping = false;
+
+        // Runs the range of the given worker (if any) for the current loop
+        void runRange(size_t worker){
+            size_t begin = worker * rangeSize;
+            size_t end = std::min(begin + rangeSize, itemCount);
+            if(begin < end) invoke(function, begin, end, worker);
+        }
+
+        void workerLoop(size_t worker){
+            uint64_t seenGeneration = 0;
+            while(true){
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    startCondition.wait(lock, [&]{ return stopping || generation != seenGeneration; });
+                    if(stopping) return;
+                    seenGeneration = generation;
+                }
+                runRange(worker);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(--pendingWorkers == 0) doneCondition.notify_one();
+                }
+            }
+        }
+
+        size_t getWorkersFor(size_t count, size_t minItemsPerWorker) const {
+            return std::min(getWorkerCount(), std::max<size_t>(1, count / std::max<size_t>(1, minItemsPerWorker)));
+        }
+
+    public:
+        // Creates a pool with the given number of workers (including the calling thread)
+        // If workerCount is 0, we use the number of hardware threads
+        explicit WorkerPool(size_t workerCount = 0){
+            if(workerCount == 0) workerCount = std::max(1u, std::thread::hardware_concurrency());
+            for(size_t worker = 1; worker < workerCount; worker++){
+                threads.emplace_back(&WorkerPool::workerLoop, this, worker);
+            }
+        }
+
+        ~WorkerPool(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            startCondition.notify_all();
+            for(auto& thread : threads) thread.join();
+        }
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        // The number of workers including the calling thread
+        size_t getWorkerCount() const { return threads.size() + 1; }
+
+        // Returns the size of the ranges that "parallelFor" will split the items into (the last range could be smaller)
+        // Range i covers the items [i * rangeSize, (i + 1) * rangeSize), this is useful to allocate a per-range output before the loop starts
+        size_t getRangeSize(size_t count, size_t minItemsPerWorker) const {
+            size_t workers = getWorkersFor(count, minItemsPerWorker);
+            return (count + workers - 1) / workers;
+        }
+
+        // Splits the items [0, count) into one contiguous range per worker and runs "function" on all the ranges in parallel
+        // "function" is called as function(begin, end, worker) to process the items in the range [begin, end)
+        // where "worker" is the index of the range (0 is run by the calling thread). It can be used to pick a per-range output (e.g. a bucket)
+        // so that the workers never write to the same memory
+        // It returns after all the ranges are processed. If there are less than "minItemsPerWorker" items per worker,
+        // fewer workers are used since waking up a thread costs more than processing a few items
+        template<typename Function>
+        void parallelFor(size_t count, size_t minItemsPerWorker, const Function& function){
+            if(count == 0) return;
+            size_t workers = getWorkersFor(count, minItemsPerWorker);
+            if(workers == 1){
+                function(0, count, 0);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                this->function = &function;
+                this->invoke = [](const void* function, size_t begin, size_t end, size_t worker){
+                    (*static_cast<const Function*>(function))(begin, end, worker);
+                };
+                itemCount = count;
+                rangeSize = getRangeSize(count, minItemsPerWorker);
+                // All the threads wake up, but the ones beyond "workers" get an empty range
+                pendingWorkers = threads.size();
+                generation++;
+            }
+            startCondition.notify_all();
+            runRange(0);
+            std::unique_lock<std::mutex> lock(mutex);
+            doneCondition.wait(lock, [&]{ return pendingWorkers == 0; });
+            this->function = nullptr;
+        }
+    };
+
+}
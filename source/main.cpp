@@ -4,6 +4,8 @@
 #include <json/json.hpp>
 
 #include <application.hpp>
+#include <shader/shader.hpp>
+#include <gpu-profiler.hpp>
 
 #include "states/menu-state.hpp"
 #include "states/play-state.hpp"
@@ -17,6 +19,7 @@
 #include "states/material-test-state.hpp"
 #include "states/entity-test-state.hpp"
 #include "states/renderer-test-state.hpp"
+#include "states/benchmark-state.hpp"
 
 int main(int argc, char** argv) {
     
@@ -28,6 +31,15 @@ int main(int argc, char** argv) {
     // This is useful for testing multiple configurations in a batch
     // Default: 0 where the application runs indefinitely until manually closed
     int run_for_frames = args.get<int>("f", 0);
+    // uniform-cache decides whether the shaders use their cached uniform locations or query them from the driver on every set
+    // This is useful for measuring the cost of the uniform uploads (e.g. -f=1000 -uniform-cache=false)
+    // Default: true
+    our::ShaderProgram::useLocationCache = args.get<bool>("uniform-cache", true);
+    // gpu-profile is the path of a JSON file to which the GPU time of each profiled scope (renderer passes, ImGui, etc.) is written at exit
+    // Giving it also enables the GPU profiler (which shows the timings in an ImGui window while running)
+    // Default: "" where the profiler is disabled
+    our::GpuProfiler::reportPath = args.get<std::string>("gpu-profile", "");
+    our::GpuProfiler::setEnabled(!our::GpuProfiler::reportPath.empty());
 
     // Open the config file and exit if failed
     std::ifstream file_in(config_path);
@@ -55,6 +67,7 @@ int main(int argc, char** argv) {
     app.registerState<MaterialTestState>("material-test");
     app.registerState<EntityTestState>("entity-test");
     app.registerState<RendererTestState>("renderer-test");
+    app.registerState<BenchmarkState>("benchmark");
     // Then choose the state to run based on the option "start-scene" in the config
     if(app_config.contains(std::string{"start-scene"})){
         app.changeState(app_config["start-scene"].get<std::string>());
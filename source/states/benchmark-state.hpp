@@ -0,0 +1,432 @@
+#pragma once
+
+#include <application.hpp>
+#include <matrix-utils.hpp>
+#include <systems/radix-sort.hpp>
+#include <systems/movement.hpp>
+#include <ecs/transform-batch.hpp>
+#include <components/collision.hpp>
+
+#include <imgui.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/euler_angles.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// This state runs CPU micro-benchmarks, each compares an optimized code path against the path it replaced.
+// The benchmarks to run are listed in the scene config under "benchmarks", for example:
+//     "benchmarks": [ { "name": "normal-matrix", "count": 100000, "repetitions": 20 } ]
+// The results are printed to the console (so they can be collected by running with -f=1) and shown using ImGui.
+class BenchmarkState: public our::State {
+
+    // The result of comparing two implementations of the same operation
+    struct BenchmarkResult {
+        std::string name;
+        std::string baselineName, optimizedName;
+        double baselineNanoseconds, optimizedNanoseconds; // The time per item of the best repetition
+        double maxError; // The largest difference between the outputs of the two implementations (or the number of wrong results)
+    };
+    std::vector<BenchmarkResult> results;
+
+    // Runs "function" (which processes "count" items) multiple times and returns the time per item of the fastest run in nanoseconds
+    // We pick the fastest run since it is the one least affected by the other processes running on the machine
+    template<typename Function>
+    static double measure(Function function, size_t count, int repetitions){
+        double best = 1e30;
+        for(int repetition = 0; repetition < repetitions; repetition++){
+            auto start = std::chrono::high_resolution_clock::now();
+            function();
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / count);
+        }
+        return best;
+    }
+
+    // Generates random affine matrices (translation, rotation & non-uniform scale) like the ones we get from the entities
+    static std::vector<glm::mat4> randomAffineMatrices(size_t count){
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f), angle(-glm::pi<float>(), glm::pi<float>()), scale(0.1f, 10.0f);
+        std::vector<glm::mat4> matrices(count);
+        for(auto& matrix : matrices){
+            matrix = glm::translate(glm::mat4(1.0f), glm::vec3(position(generator), position(generator), position(generator))) *
+                     glm::yawPitchRoll(angle(generator), angle(generator), angle(generator)) *
+                     glm::scale(glm::mat4(1.0f), glm::vec3(scale(generator), scale(generator), scale(generator)));
+        }
+        return matrices;
+    }
+
+    // Compares the full 4x4 inverse transpose that the renderer used to compute for every lit draw
+    // against the 3x3 cofactor based normal matrix (matrix_utils::normalMatrix)
+    static BenchmarkResult benchmarkNormalMatrix(const nlohmann::json& config){
+        size_t count = config.value("count", 100000);
+        int repetitions = config.value("repetitions", 20);
+        std::vector<glm::mat4> matrices = randomAffineMatrices(count);
+        std::vector<glm::mat4> baseline(count);
+        std::vector<glm::mat3> optimized(count);
+
+        BenchmarkResult result;
+        result.name = "normal-matrix";
+        result.baselineName = "inverse(transpose(mat4))";
+        result.optimizedName = "matrix_utils::normalMatrix";
+        result.baselineNanoseconds = measure([&](){
+            for(size_t i = 0; i < count; i++) baseline[i] = glm::inverse(glm::transpose(matrices[i]));
+        }, count, repetitions);
+        result.optimizedNanoseconds = measure([&](){
+            for(size_t i = 0; i < count; i++) optimized[i] = our::matrix_utils::normalMatrix(matrices[i]);
+        }, count, repetitions);
+
+        // Both should give the same upper 3x3 part (the error is relative to the size of the matrix elements)
+        result.maxError = 0;
+        for(size_t i = 0; i < count; i++){
+            glm::mat3 expected = glm::mat3(baseline[i]);
+            float size = 0;
+            for(int column = 0; column < 3; column++) size = glm::max(size, glm::length(expected[column]));
+            for(int column = 0; column < 3; column++){
+                glm::vec3 difference = glm::abs(expected[column] - optimized[i][column]);
+                result.maxError = glm::max(result.maxError, (double)glm::max(difference.x, glm::max(difference.y, difference.z)) / size);
+            }
+        }
+        return result;
+    }
+
+    // Compares sorting the transparent objects using std::sort with a comparator that computes the distance of both objects in every comparison
+    // against computing the view depth of each object once and radix sorting the keys (what the renderer does)
+    // The objects are randomly placed glass panels in front of a camera. The error is the number of objects that are not in back to front order
+    static BenchmarkResult benchmarkTransparentSort(const nlohmann::json& config){
+        size_t count = config.value("count", 5000);
+        int repetitions = config.value("repetitions", 20);
+        std::vector<glm::mat4> panels = randomAffineMatrices(count);
+        std::vector<glm::vec3> centers(count);
+        for(size_t i = 0; i < count; i++) centers[i] = glm::vec3(panels[i][3]);
+        glm::mat4 V = glm::lookAt(glm::vec3(0, 0, 150), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+        glm::vec3 cameraPosition = glm::vec3(0, 0, 150), cameraForward = glm::vec3(0, 0, -1);
+
+        std::vector<uint32_t> baseline(count);
+        std::vector<our::SortEntry> optimized(count), scratch(count);
+
+        BenchmarkResult result;
+        result.name = "transparent-sort";
+        result.baselineName = "std::sort (dot per comparison)";
+        result.optimizedName = "view depth keys + radixSort";
+        result.baselineNanoseconds = measure([&](){
+            for(size_t i = 0; i < count; i++) baseline[i] = (uint32_t)i;
+            std::sort(baseline.begin(), baseline.end(), [&](uint32_t first, uint32_t second){
+                return glm::dot(cameraForward, centers[first] - cameraPosition) > glm::dot(cameraForward, centers[second] - cameraPosition);
+            });
+        }, count, repetitions);
+        result.optimizedNanoseconds = measure([&](){
+            for(size_t i = 0; i < count; i++){
+                float depth = -(V * glm::vec4(centers[i], 1.0f)).z;
+                optimized[i] = {our::floatToSortableBits(-depth), (uint32_t)i};
+            }
+            our::radixSort(optimized.data(), scratch.data(), count);
+        }, count, repetitions);
+
+        // Every object must be at least as far from the camera as the one drawn after it
+        result.maxError = 0;
+        for(size_t i = 0; i + 1 < count; i++){
+            float depth = -(V * glm::vec4(centers[optimized[i].index], 1.0f)).z;
+            float nextDepth = -(V * glm::vec4(centers[optimized[i + 1].index], 1.0f)).z;
+            if(depth < nextDepth) result.maxError++;
+        }
+        return result;
+    }
+
+    // Compares moving the entities that have a movement component when every entity keeps a list of separately allocated components
+    // (the layout the ECS used before the archetypes, where each entity is searched using dynamic_cast) against the MovementSystem
+    // which walks over the contiguous movement components of the archetypes. A third of the entities also have a collision component,
+    // so the movement components are split between two archetypes. The error is the largest difference between the final positions
+    static BenchmarkResult benchmarkEcsIteration(const nlohmann::json& config){
+        size_t count = config.value("count", 100000);
+        int repetitions = config.value("repetitions", 20);
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+
+        // The old layout: an unordered set of entities, each with a linked list of components allocated one by one
+        struct ListEntity {
+            std::list<our::Component*> components;
+            our::Transform localTransform;
+        };
+        std::vector<ListEntity*> listEntities(count);
+        std::unordered_set<ListEntity*> listSet;
+        our::World world;
+        std::vector<our::Entity*> worldEntities(count);
+        for(size_t i = 0; i < count; i++){
+            glm::vec3 linear = glm::vec3(velocity(generator), velocity(generator), velocity(generator));
+            glm::vec3 angular = glm::vec3(velocity(generator), velocity(generator), velocity(generator));
+
+            ListEntity* listEntity = listEntities[i] = new ListEntity();
+            auto listMovement = new our::MovementComponent();
+            listMovement->linearVelocity = linear;
+            listMovement->angularVelocity = angular;
+            listEntity->components.push_back(listMovement);
+            if(i % 3 == 0) listEntity->components.push_front(new our::CollisionComponent());
+            listSet.insert(listEntity);
+
+            our::Entity* entity = worldEntities[i] = world.add();
+            entity->parent = nullptr;
+            auto movement = entity->addComponent<our::MovementComponent>();
+            movement->linearVelocity = linear;
+            movement->angularVelocity = angular;
+            if(i % 3 == 0) entity->addComponent<our::CollisionComponent>();
+        }
+
+        const float deltaTime = 1.0f / 60.0f;
+        our::MovementSystem movementSystem;
+        BenchmarkResult result;
+        result.name = "ecs-iteration";
+        result.baselineName = "component lists + dynamic_cast";
+        result.optimizedName = "archetype chunks (MovementSystem)";
+        result.baselineNanoseconds = measure([&](){
+            for(auto entity : listSet){
+                for(auto component : entity->components){
+                    if(auto movement = dynamic_cast<our::MovementComponent*>(component); movement){
+                        entity->localTransform.position += deltaTime * movement->linearVelocity;
+                        entity->localTransform.rotation += deltaTime * movement->angularVelocity;
+                        break;
+                    }
+                }
+            }
+        }, count, repetitions);
+        result.optimizedNanoseconds = measure([&](){
+            movementSystem.update(&world, deltaTime);
+        }, count, repetitions);
+
+        // Both ran the same number of updates, so every entity should end up at the same place
+        result.maxError = 0;
+        for(size_t i = 0; i < count; i++){
+            glm::vec3 difference = glm::abs(listEntities[i]->localTransform.position - worldEntities[i]->localTransform.position);
+            result.maxError = glm::max(result.maxError, (double)glm::max(difference.x, glm::max(difference.y, difference.z)));
+        }
+        for(auto entity : listEntities){
+            for(auto component : entity->components) delete component;
+            delete entity;
+        }
+        return result;
+    }
+
+    // Compares the MovementSystem before the views (looping over all the entities and calling getComponent on each of them)
+    // against the MovementSystem using "World::view" which only visits the archetypes that have a movement component.
+    // Only "movingFraction" of the entities move (the rest have a collision component), like a scene with a lot of static objects.
+    // Both versions run on identical worlds, the error is the largest difference between the final positions.
+    // The time is per entity in the world (not per moving entity)
+    static BenchmarkResult benchmarkEcsView(const nlohmann::json& config){
+        size_t count = config.value("count", 100000);
+        int repetitions = config.value("repetitions", 20);
+        float movingFraction = config.value("movingFraction", 0.01f);
+        size_t movingStride = std::max<size_t>(1, (size_t)std::round(1.0f / movingFraction));
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+
+        our::World baselineWorld, optimizedWorld;
+        std::vector<our::Entity*> baselineEntities(count), optimizedEntities(count);
+        for(size_t i = 0; i < count; i++){
+            glm::vec3 linear = glm::vec3(velocity(generator), velocity(generator), velocity(generator));
+            our::World* worlds[2] = {&baselineWorld, &optimizedWorld};
+            our::Entity** entities[2] = {&baselineEntities[i], &optimizedEntities[i]};
+            for(int w = 0; w < 2; w++){
+                our::Entity* entity = *entities[w] = worlds[w]->add();
+                entity->parent = nullptr;
+                if(i % movingStride == 0) entity->addComponent<our::MovementComponent>()->linearVelocity = linear;
+                else entity->addComponent<our::CollisionComponent>();
+            }
+        }
+
+        const float deltaTime = 1.0f / 60.0f;
+        our::MovementSystem movementSystem;
+        BenchmarkResult result;
+        result.name = "ecs-view";
+        result.baselineName = "getEntities + getComponent";
+        result.optimizedName = "view<MovementComponent>";
+        result.baselineNanoseconds = measure([&](){
+            for(auto entity : baselineWorld.getEntities()){
+                if(auto movement = entity->getComponent<our::MovementComponent>(); movement){
+                    entity->localTransform.position += deltaTime * movement->linearVelocity;
+                    entity->localTransform.rotation += deltaTime * movement->angularVelocity;
+                }
+            }
+        }, count, repetitions);
+        result.optimizedNanoseconds = measure([&](){
+            movementSystem.update(&optimizedWorld, deltaTime);
+        }, count, repetitions);
+
+        result.maxError = 0;
+        for(size_t i = 0; i < count; i++){
+            glm::vec3 difference = glm::abs(baselineEntities[i]->localTransform.position - optimizedEntities[i]->localTransform.position);
+            result.maxError = glm::max(result.maxError, (double)glm::max(difference.x, glm::max(difference.y, difference.z)));
+        }
+        return result;
+    }
+
+    // Compares getting the world matrix of every entity by rebuilding the parent chain on each call (what getLocalToWorldMatrix did
+    // before the matrices were cached) against the transform update pass followed by reading the cached matrices.
+    // The world is made of vehicles (a body with "depth" levels of children below it) and only "movingFraction" of the vehicles move
+    // every frame. Each repetition is one frame where every matrix is read "callsPerFrame" times (by the renderer, collision, ...).
+    // The time is per entity and the error is the largest difference between the matrices of the two versions
+    static BenchmarkResult benchmarkTransformHierarchy(const nlohmann::json& config){
+        size_t count = config.value("count", 100000);
+        int repetitions = config.value("repetitions", 20);
+        int depth = std::max(config.value("depth", 4), 1);
+        int callsPerFrame = std::max(config.value("callsPerFrame", 2), 1);
+        float movingFraction = config.value("movingFraction", 0.01f);
+        size_t movingStride = std::max<size_t>(1, (size_t)std::round(1.0f / movingFraction));
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+        our::World world;
+        std::vector<our::Entity*> entities, movingRoots;
+        for(size_t vehicle = 0; entities.size() < count; vehicle++){
+            our::Entity* parent = nullptr;
+            for(int level = 0; level < depth && entities.size() < count; level++){
+                our::Entity* entity = world.add();
+                entity->parent = parent;
+                entity->localTransform.position = glm::vec3(offset(generator), offset(generator), offset(generator)) * 10.0f;
+                entity->localTransform.rotation = glm::vec3(offset(generator), offset(generator), offset(generator));
+                entities.push_back(entity);
+                if(level == 0 && vehicle % movingStride == 0) movingRoots.push_back(entity);
+                parent = entity;
+            }
+        }
+        // The matrices of the old version, computed recursively up the parent chain every time
+        auto recursiveMatrix = [](const our::Entity* entity){
+            glm::mat4 localToWorld = entity->localTransform.toMat4();
+            for(const our::Entity* ancestor = entity->parent; ancestor != nullptr; ancestor = ancestor->parent){
+                localToWorld = ancestor->localTransform.toMat4() * localToWorld;
+            }
+            return localToWorld;
+        };
+        world.updateTransforms();
+
+        std::vector<glm::mat4> baseline(entities.size()), optimized(entities.size());
+        auto moveVehicles = [&](){
+            for(auto root : movingRoots) root->localTransform.rotation.y += 0.01f;
+        };
+        BenchmarkResult result;
+        result.name = "transform-hierarchy";
+        result.baselineName = "recursive getLocalToWorldMatrix";
+        result.optimizedName = "updateTransforms + cached matrices";
+        result.baselineNanoseconds = measure([&](){
+            moveVehicles();
+            for(int call = 0; call < callsPerFrame; call++){
+                for(size_t i = 0; i < entities.size(); i++) baseline[i] = recursiveMatrix(entities[i]);
+            }
+        }, entities.size(), repetitions);
+        result.optimizedNanoseconds = measure([&](){
+            moveVehicles();
+            world.updateTransforms();
+            for(int call = 0; call < callsPerFrame; call++){
+                for(size_t i = 0; i < entities.size(); i++) optimized[i] = entities[i]->getLocalToWorldMatrix();
+            }
+        }, entities.size(), repetitions);
+
+        // The optimized run moved the vehicles once more after the baseline, so the baseline is recomputed for the final transforms
+        result.maxError = 0;
+        for(size_t i = 0; i < entities.size(); i++){
+            glm::mat4 expected = recursiveMatrix(entities[i]);
+            for(int column = 0; column < 4; column++){
+                glm::vec4 difference = glm::abs(expected[column] - optimized[i][column]);
+                result.maxError = glm::max(result.maxError, (double)glm::max(glm::max(difference.x, difference.y), glm::max(difference.z, difference.w)));
+            }
+        }
+        return result;
+    }
+
+    // Compares Transform::toMat4 (translate * yawPitchRoll * scale using glm) on an array of transforms
+    // against the batch kernel (transform_utils::toMat4Batch) on the same transforms stored as a structure of arrays.
+    // The angles cover a few turns so that the range reduction of the SIMD sine & cosine is exercised.
+    // This is also the correctness test of the kernel: the error is the largest difference from toMat4 relative to the size of the matrix columns
+    static BenchmarkResult benchmarkTransformBatch(const nlohmann::json& config){
+        size_t count = config.value("count", 100000);
+        int repetitions = config.value("repetitions", 20);
+        std::mt19937 generator(42);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f), angle(-4.0f * glm::pi<float>(), 4.0f * glm::pi<float>()), scale(0.1f, 10.0f);
+        std::vector<our::Transform> transforms(count);
+        our::TransformArrays arrays;
+        for(auto& transform : transforms){
+            transform.position = glm::vec3(position(generator), position(generator), position(generator));
+            transform.rotation = glm::vec3(angle(generator), angle(generator), angle(generator));
+            transform.scale = glm::vec3(scale(generator), scale(generator), scale(generator));
+            arrays.push_back(transform);
+        }
+        std::vector<glm::mat4> baseline(count), optimized(count);
+
+        BenchmarkResult result;
+        result.name = "transform-batch";
+        result.baselineName = "Transform::toMat4";
+        result.optimizedName = "transform_utils::toMat4Batch";
+        result.baselineNanoseconds = measure([&](){
+            for(size_t i = 0; i < count; i++) baseline[i] = transforms[i].toMat4();
+        }, count, repetitions);
+        result.optimizedNanoseconds = measure([&](){
+            our::transform_utils::toMat4Batch(arrays, optimized.data());
+        }, count, repetitions);
+
+        result.maxError = 0;
+        for(size_t i = 0; i < count; i++){
+            float size = 0;
+            for(int column = 0; column < 4; column++) size = glm::max(size, glm::length(glm::vec3(baseline[i][column])));
+            for(int column = 0; column < 4; column++){
+                glm::vec4 difference = glm::abs(baseline[i][column] - optimized[i][column]);
+                result.maxError = glm::max(result.maxError, (double)glm::max(glm::max(difference.x, difference.y), glm::max(difference.z, difference.w)) / size);
+            }
+        }
+        return result;
+    }
+
+    void onInitialize() override {
+        // First of all, we get the scene configuration from the app config
+        auto& config = getApp()->getConfig()["scene"];
+        results.clear();
+        if(config.contains("benchmarks") && config["benchmarks"].is_array()){
+            for(auto& benchmark : config["benchmarks"]){
+                std::string name = benchmark.value("name", "");
+                if(name == "normal-matrix"){
+                    results.push_back(benchmarkNormalMatrix(benchmark));
+                } else if(name == "transparent-sort"){
+                    results.push_back(benchmarkTransparentSort(benchmark));
+                } else if(name == "ecs-iteration"){
+                    results.push_back(benchmarkEcsIteration(benchmark));
+                } else if(name == "ecs-view"){
+                    results.push_back(benchmarkEcsView(benchmark));
+                } else if(name == "transform-hierarchy"){
+                    results.push_back(benchmarkTransformHierarchy(benchmark));
+                } else if(name == "transform-batch"){
+                    results.push_back(benchmarkTransformBatch(benchmark));
+                } else {
+                    std::cerr << "Unknown benchmark: " << name << std::endl;
+                }
+            }
+        }
+        for(auto& result : results){
+            std::cout << "Benchmark " << result.name << ":" << std::endl;
+            std::cout << "    " << result.baselineName << ": " << result.baselineNanoseconds << " ns/item" << std::endl;
+            std::cout << "    " << result.optimizedName << ": " << result.optimizedNanoseconds << " ns/item" << std::endl;
+            std::cout << "    speedup: " << result.baselineNanoseconds / result.optimizedNanoseconds << "x, max relative error: " << result.maxError << std::endl;
+        }
+    }
+
+    void onImmediateGui() override {
+        ImGui::Begin("Benchmarks");
+        for(auto& result : results){
+            ImGui::Text("%s", result.name.c_str());
+            ImGui::Text("    %s: %.2f ns/item", result.baselineName.c_str(), result.baselineNanoseconds);
+            ImGui::Text("    %s: %.2f ns/item", result.optimizedName.c_str(), result.optimizedNanoseconds);
+            ImGui::Text("    speedup: %.2fx, max relative error: %g", result.baselineNanoseconds / result.optimizedNanoseconds, result.maxError);
+        }
+        ImGui::End();
+    }
+
+    void onDraw(double deltaTime) override {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+};
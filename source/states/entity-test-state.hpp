@@ -9,11 +9,8 @@
 // This is a helper function that will search for a component and will return the first one found
 template<typename T>
 T* find(our::World *world){
-    for(auto& entity : world->getEntities()){
-        T* component = entity->getComponent<T>();
-        if(component) return component;
-    }
-    return nullptr;
+    our::Entity* entity = world->view<T>().front();
+    return entity ? entity->getComponent<T>() : nullptr;
 }
 
 // This state tests and shows how to use the ECS framework and deserialization.
@@ -47,16 +44,14 @@ class EntityTestState: public our::State {
         //TODO: (Req 8) Change the following line to compute the correct view projection matrix 
         glm::mat4 VP = camera->getProjectionMatrix(size) * camera->getViewMatrix();
 
-        for(auto& entity : world.getEntities()){
-            // For each entity, we look for a mesh renderer (if none was found, we skip this entity)
-            our::MeshRendererComponent* meshRenderer = entity->getComponent<our::MeshRendererComponent>();
-            if(meshRenderer == nullptr) continue;
+        // For each entity that has a mesh renderer (the view skips the other entities)
+        world.view<our::MeshRendererComponent>().each([&](our::Entity* entity, our::MeshRendererComponent& meshRenderer){
             //TODO: (Req 8) Complete the loop body to draw the current entity
             // Then we setup the material, send the transform matrix to the shader then draw the mesh
-            meshRenderer->material->setup();
-            meshRenderer->material->shader->set("transform", VP * meshRenderer->getOwner()->getLocalToWorldMatrix());
-            meshRenderer->mesh->draw();
-        }
+            meshRenderer.material->setup();
+            meshRenderer.material->shader->set("transform", VP * entity->getLocalToWorldMatrix());
+            meshRenderer.mesh->draw();
+        });
     }
 
     void onDestroy() override {
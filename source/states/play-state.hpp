@@ -37,6 +37,11 @@ class Playstate: public our::State {
         renderer.initialize(size, config["renderer"]);
     }
 
+    void onImmediateGui() override {
+        // The renderer shows its statistics if "showStats" is enabled in its configuration
+        renderer.onImmediateGui();
+    }
+
     void onDraw(double deltaTime) override {
         // Here, we just run a bunch of systems to control the world logic
         movementSystem.update(&world, (float)deltaTime);
@@ -30,6 +30,11 @@ class RendererTestState: public our::State {
         renderer.initialize(size, config["renderer"]);
     }
 
+    void onImmediateGui() override {
+        // The renderer shows its statistics if "showStats" is enabled in its configuration
+        renderer.onImmediateGui();
+    }
+
     void onDraw(double deltaTime) override {
         // We simply call the renderer's "render" function and it should do all the rendering work
         renderer.render(&world);